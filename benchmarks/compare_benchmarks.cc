@@ -0,0 +1,319 @@
+/* Compare two Google Benchmark JSON result files and gate on regressions.
+ *
+ *   compare_benchmarks [options] baseline.json contender.json
+ *
+ *   --threshold=F   relative slowdown that counts as a regression (0.05)
+ *   --noise=K       slowdown must also exceed K robust sigmas (3)
+ *   --gate=PREFIX   benchmarks whose regressions fail the run; repeatable.
+ *                   Defaults to BM_EncodeSequence and BM_HPack (which
+ *                   includes the Huffman string cases)
+ *   --all           gate every benchmark
+ *
+ * With --benchmark_repetitions, per-repetition runs give a median and a
+ * MAD (scaled to sigma); aggregate-only files fall back to the reported
+ * median and stddev. Single runs are compared on the threshold alone.
+ * A gated baseline benchmark that the contender is missing, or only has
+ * errored runs of, fails the gate as well (MISSING, ERROR).
+ * Exits 1 if any gated benchmark regressed or failed, 2 on usage or parse
+ * errors.
+ *
+ * Build: c++ -std=c++20 -O2 benchmarks/compare_benchmarks.cc -o compare_benchmarks
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/* Just enough JSON for benchmark output */
+struct JsonValue {
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    const JsonValue *get(const std::string& key) const {
+        for (const auto& member : object)
+            if (member.first == key) return &member.second;
+        return nullptr;
+    }
+};
+
+struct JsonParser {
+    const char *p, *end;
+
+    void skip() { while (p < end && isspace((unsigned char)*p)) p++; }
+
+    bool expect(char c) {
+        skip();
+        if (p < end && *p == c) { p++; return true; }
+        return false;
+    }
+
+    bool parse_string(std::string& out) {
+        if (!expect('"')) return false;
+        while (p < end && *p != '"') {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+                switch (*p) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'r': out += '\r'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'u':
+                        // Names are ASCII; keep escapes verbatim
+                        out += "\\u";
+                        break;
+                    default: out += *p;
+                }
+                p++;
+            } else {
+                out += *p++;
+            }
+        }
+        return expect('"');
+    }
+
+    bool parse(JsonValue& v) {
+        skip();
+        if (p >= end) return false;
+
+        if (*p == '{') {
+            p++;
+            v.type = JsonValue::OBJECT;
+            if (expect('}')) return true;
+            do {
+                std::string key;
+                JsonValue value;
+                if (!parse_string(key) || !expect(':') || !parse(value)) return false;
+                v.object.emplace_back(std::move(key), std::move(value));
+            } while (expect(','));
+            return expect('}');
+        }
+
+        if (*p == '[') {
+            p++;
+            v.type = JsonValue::ARRAY;
+            if (expect(']')) return true;
+            do {
+                v.array.emplace_back();
+                if (!parse(v.array.back())) return false;
+            } while (expect(','));
+            return expect(']');
+        }
+
+        if (*p == '"') {
+            v.type = JsonValue::STRING;
+            return parse_string(v.string);
+        }
+
+        if (!strncmp(p, "true", 4)) { p += 4; v.type = JsonValue::BOOL; v.boolean = true; return true; }
+        if (!strncmp(p, "false", 5)) { p += 5; v.type = JsonValue::BOOL; return true; }
+        if (!strncmp(p, "null", 4)) { p += 4; return true; }
+
+        char *num_end;
+        v.type = JsonValue::NUMBER;
+        v.number = strtod(p, &num_end);
+        if (num_end == p) return false;
+        p = num_end;
+        return true;
+    }
+};
+
+/* Samples of one benchmark, in nanoseconds of CPU time */
+struct BenchmarkSamples {
+    std::vector<double> runs;
+    double median = NAN;
+    double stddev = NAN;
+    bool error = false;     // Some run reported error_occurred
+
+    /* Robust center and spread */
+    std::pair<double, double> summary() const {
+        if (runs.size() >= 2) {
+            std::vector<double> v = runs;
+            auto med = [](std::vector<double>& x) {
+                std::sort(x.begin(), x.end());
+                size_t n = x.size();
+                return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+            };
+
+            double center = med(v);
+            for (auto& x : v) x = fabs(x - center);
+
+            return { center, 1.4826 * med(v) };
+        }
+
+        if (!std::isnan(median))
+            return { median, std::isnan(stddev) ? 0 : stddev };
+
+        return { runs.empty() ? NAN : runs[0], 0 };
+    }
+};
+
+static double to_ns(double value, const JsonValue *unit)
+{
+    if (!unit) return value;
+    if (unit->string == "us") return value * 1e3;
+    if (unit->string == "ms") return value * 1e6;
+    if (unit->string == "s") return value * 1e9;
+    return value;
+}
+
+static bool load(const char *path, std::map<std::string, BenchmarkSamples>& out)
+{
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return false;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+    std::string data = text.str();
+
+    JsonValue root;
+    JsonParser parser { data.data(), data.data() + data.size() };
+    if (!parser.parse(root) || root.type != JsonValue::OBJECT) {
+        fprintf(stderr, "%s: not valid JSON\n", path);
+        return false;
+    }
+
+    const JsonValue *benchmarks = root.get("benchmarks");
+    if (!benchmarks || benchmarks->type != JsonValue::ARRAY) {
+        fprintf(stderr, "%s: no \"benchmarks\" array\n", path);
+        return false;
+    }
+
+    for (const auto& b : benchmarks->array) {
+        const JsonValue *name = b.get("run_name");
+        if (!name) name = b.get("name");
+        const JsonValue *cpu = b.get("cpu_time");
+        const JsonValue *error = b.get("error_occurred");
+        if (!name)
+            continue;
+
+        if (error && error->boolean) {
+            out[name->string].error = true;
+            continue;
+        }
+        if (!cpu)
+            continue;
+
+        double ns = to_ns(cpu->number, b.get("time_unit"));
+        BenchmarkSamples& samples = out[name->string];
+
+        const JsonValue *run_type = b.get("run_type");
+        if (!run_type || run_type->string == "iteration") {
+            samples.runs.push_back(ns);
+            continue;
+        }
+
+        const JsonValue *aggregate = b.get("aggregate_name");
+        if (!aggregate) continue;
+        if (aggregate->string == "median") samples.median = ns;
+        if (aggregate->string == "stddev") samples.stddev = ns;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    double threshold = 0.05;
+    double noise = 3;
+    bool gate_all = false;
+    std::vector<std::string> gates;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--threshold=", 12)) threshold = atof(argv[i] + 12);
+        else if (!strncmp(argv[i], "--noise=", 8)) noise = atof(argv[i] + 8);
+        else if (!strncmp(argv[i], "--gate=", 7)) gates.push_back(argv[i] + 7);
+        else if (!strcmp(argv[i], "--all")) gate_all = true;
+        else files.push_back(argv[i]);
+    }
+
+    if (files.size() != 2) {
+        fprintf(stderr, "usage: %s [--threshold=F] [--noise=K] [--gate=PREFIX]... "
+                "[--all] baseline.json contender.json\n", argv[0]);
+        return 2;
+    }
+
+    if (gates.empty())
+        gates = { "BM_EncodeSequence", "BM_HPack" };
+
+    std::map<std::string, BenchmarkSamples> baseline, contender;
+    if (!load(files[0], baseline) || !load(files[1], contender))
+        return 2;
+
+    int regressions = 0, failures = 0;
+    printf("%-48s %12s %12s %8s  %s\n", "benchmark", "base ns", "new ns", "delta", "verdict");
+
+    for (const auto& [name, base_samples] : baseline) {
+        auto [base, base_sigma] = base_samples.summary();
+        if (std::isnan(base) || base <= 0)
+            continue;
+
+        bool gated = gate_all || std::any_of(gates.begin(), gates.end(),
+                [&](const std::string& prefix) { return !name.compare(0, prefix.size(), prefix); });
+
+        // No valid sample is as bad as a regression, or the gate fails open
+        auto it = contender.find(name);
+        double now = NAN, now_sigma = 0;
+        if (it != contender.end())
+            std::tie(now, now_sigma) = it->second.summary();
+
+        if (std::isnan(now) || now <= 0) {
+            bool error = it != contender.end() && it->second.error;
+            const char *verdict = error ? "ERROR" : "MISSING";
+            if (!gated)
+                verdict = error ? "error (not gated)" : "missing (not gated)";
+
+            printf("%-48s %12.1f %12s %8s  %s\n", name.c_str(), base, "", "", verdict);
+            failures += gated;
+            continue;
+        }
+
+        double delta = (now - base) / base;
+        double sigma = std::sqrt(base_sigma * base_sigma + now_sigma * now_sigma);
+
+        bool slower = delta > threshold && (now - base) > noise * sigma;
+        bool faster = delta < -threshold && (base - now) > noise * sigma;
+
+        const char *verdict = "";
+        if (slower) {
+            verdict = gated ? "REGRESSION" : "slower (not gated)";
+            regressions += gated;
+        } else if (faster) {
+            verdict = "faster";
+        } else if (fabs(delta) > threshold) {
+            verdict = "within noise";
+        }
+
+        printf("%-48s %12.1f %12.1f %+7.1f%%  %s\n", name.c_str(), base, now,
+                delta * 100, verdict);
+    }
+
+    for (const auto& [name, samples] : contender) {
+        if (!baseline.count(name))
+            printf("%-48s %12s %12s %8s  new\n", name.c_str(), "", "", "");
+    }
+
+    if (regressions)
+        printf("\n%d gated regression%s\n", regressions, regressions == 1 ? "" : "s");
+    if (failures)
+        printf("\n%d gated benchmark%s without a valid result\n", failures,
+                failures == 1 ? "" : "s");
+
+    return regressions || failures ? 1 : 0;
+}
@@ -0,0 +1,371 @@
+/* Encoding pipeline benchmarks.
+ *
+ * Build against Google Benchmark alongside the encoder sources, e.g.
+ *   c++ -std=c++20 -O2 -I. -Igenfiles benchmarks/encoder_benchmark.cc \
+ *       *.cc genfiles/h2_*.pb.cc -lbenchmark -lprotobuf -lpthread \
+ *       -o encoder_benchmark
+ *
+ * Run with --benchmark_format=json (or --benchmark_out=FILE
+ * --benchmark_out_format=json) to get machine-readable results.
+ * compare_benchmarks.cc checks such a file against the stored baseline in
+ * baselines/. Commits that change benchmarked code regenerate it on the
+ * gating host, with every repetition kept so the comparator gets a median
+ * and MAD, and with the default priority_stress pack as the corpus:
+ *   priority_stress stress.pack && corpus_pack_tool unpack stress.pack stress
+ *   H2_BENCH_CORPUS=stress ./encoder_benchmark --benchmark_repetitions=5 \
+ *       --benchmark_out=benchmarks/baselines/encoder_benchmark.json \
+ *       --benchmark_out_format=json
+ * Set H2_BENCH_CORPUS to a directory of Conversations, text or binary (as
+ * written by wireshark/cap.py), to include the pcap-derived corpus;
+ * BM_EncodeSequencePcap only compares against runs on the same corpus.
+ */
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/io/tokenizer.h>
+#include <google/protobuf/text_format.h>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "protobuf_encoders.h"
+#include "hpack_compressor.h"
+#include "encoding_context.h"
+#include "protobuf_decoders.h"
+#include "frame_scanner.h"
+#include "server_stub.h"
+
+static std::string random_token(std::mt19937& rng, size_t length)
+{
+    static const char alphabet[] =
+        "abcdefghijklmnopqrstuvwxyz0123456789-_/.:;=ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    std::string s(length, '\0');
+    for (auto& c : s) c = alphabet[rng() % (sizeof(alphabet) - 1)];
+
+    return s;
+}
+
+static void set_string(h2proto::HPackString *str, const std::string& data,
+        bool huffman)
+{
+    str->set_data(data);
+    str->set_force_literal(false);
+    str->set_huffman(huffman);
+}
+
+static void add_header(google::protobuf::RepeatedPtrField<h2proto::HeaderField> *list,
+        const std::string& name, const std::string& value, bool huffman,
+        h2proto::HeaderField::Indexing indexing)
+{
+    h2proto::HeaderField *field = list->Add();
+    set_string(field->mutable_name(), name, huffman);
+    set_string(field->mutable_value(), value, huffman);
+    field->set_indexing(indexing);
+}
+
+
+/* Encode<HPackString>: args are length, huffman */
+static void BM_HPackString(benchmark::State& state)
+{
+    std::mt19937 rng(1);
+    h2proto::HPackString str;
+    set_string(&str, random_token(rng, state.range(0)), state.range(1));
+
+    EncodeBuffer out;
+    for (auto _ : state) {
+        out.clear();
+        EncodeTo(str, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HPackString)
+    ->ArgNames({ "len", "huffman" })
+    ->ArgsProduct({ { 8, 64, 512, 4096 }, { 0, 1 } });
+
+
+/* Encode<HPackInt>: args are prefix bits, value bits */
+static void BM_HPackInt(benchmark::State& state)
+{
+    h2proto::HPackInt integer;
+    integer.set_prefix(state.range(0));
+    integer.set_msb_mask(0);
+    integer.set_value(state.range(1) ? (1ull << state.range(1)) - 1 : 0);
+
+    EncodeBuffer out;
+    for (auto _ : state) {
+        out.clear();
+        EncodeTo(integer, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+BENCHMARK(BM_HPackInt)
+    ->ArgNames({ "prefix", "bits" })
+    ->ArgsProduct({ { 4, 5, 6, 7, 8 }, { 0, 7, 14, 28, 56 } });
+
+
+/* HPackCompressor::compress: arg is dynamic table fill in percent.
+ * The measured list mixes static hits, dynamic hits and literals, all
+ * WITHOUT_INDEX so the table stays at the requested fill.
+ */
+static void BM_HPackCompress(benchmark::State& state)
+{
+    std::mt19937 rng(2);
+    HPackCompressor hpack;
+
+    google::protobuf::RepeatedPtrField<h2proto::HeaderField> fill;
+    uint32_t target = hpack.max_table_size * state.range(0) / 100;
+    uint32_t filled = 0;
+    while (filled + 32 + 24 <= target) {
+        add_header(&fill, "x-fill-" + random_token(rng, 8), random_token(rng, 9),
+                false, h2proto::HeaderField::INCREMENTAL);
+        filled += 32 + 24;
+    }
+    hpack.compress(fill);
+
+    google::protobuf::RepeatedPtrField<h2proto::HeaderField> request;
+    auto without = h2proto::HeaderField::WITHOUT_INDEX;
+    add_header(&request, ":method", "GET", false, without);
+    add_header(&request, ":scheme", "https", false, without);
+    add_header(&request, ":path", "/" + random_token(rng, 24), true, without);
+    add_header(&request, ":authority", "www.example.com", true, without);
+    add_header(&request, "user-agent", random_token(rng, 60), true, without);
+    add_header(&request, "accept", "*/*", false, without);
+    if (fill.size())
+        request.Add()->CopyFrom(fill[fill.size() / 2]);
+    add_header(&request, "x-request-id", random_token(rng, 32), false, without);
+
+    EncodeBuffer out;
+    for (auto _ : state) {
+        out.clear();
+        hpack.compress(request, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.counters["table_entries"] = hpack.dynamic_table.size();
+}
+BENCHMARK(BM_HPackCompress)->ArgName("fill_pct")->DenseRange(0, 100, 25);
+
+
+/* enframe_begin/enframe_end around a payload of the given size */
+static void BM_Enframe(benchmark::State& state)
+{
+    std::string payload(state.range(0), 'x');
+
+    EncodeBuffer out;
+    for (auto _ : state) {
+        out.clear();
+        size_t start = enframe_begin(out);
+        out += payload;
+        enframe_end(out, start, 0, 0, 1);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Enframe)->ArgName("payload")->RangeMultiplier(8)->Range(0, 1 << 15);
+
+
+/* A request-shaped sequence: HEADERS, some DATA, control frames */
+static h2proto::Sequence synthetic_sequence(size_t streams)
+{
+    std::mt19937 rng(3);
+    h2proto::Sequence seq;
+
+    h2proto::SettingsFrame *settings = seq.add_frames()->mutable_settings_frame();
+    settings->set_ack(false);
+    settings->set_initial_window_size(1 << 20);
+
+    for (size_t i = 0; i < streams; i++) {
+        uint32_t stream_id = 1 + 2 * i;
+
+        h2proto::HeadersFrame *headers = seq.add_frames()->mutable_headers_frame();
+        headers->set_stream_id(stream_id);
+        headers->set_exclusive(false);
+        headers->set_stream_dependency(0);
+        headers->set_weight(16);
+        headers->set_end_stream(i % 2);
+        headers->set_end_headers(true);
+        headers->set_priority(false);
+
+        auto incremental = h2proto::HeaderField::INCREMENTAL;
+        add_header(headers->mutable_header_list(), ":method", i % 2 ? "GET" : "POST",
+                false, incremental);
+        add_header(headers->mutable_header_list(), ":scheme", "https", false, incremental);
+        add_header(headers->mutable_header_list(), ":path",
+                "/" + random_token(rng, 20), true, incremental);
+        add_header(headers->mutable_header_list(), ":authority", "www.example.com",
+                true, incremental);
+        add_header(headers->mutable_header_list(), "cookie", random_token(rng, 40),
+                i % 3 == 0, incremental);
+
+        if (!(i % 2)) {
+            h2proto::DataFrame *data = seq.add_frames()->mutable_data_frame();
+            data->set_stream_id(stream_id);
+            data->set_end_stream(true);
+            data->set_data(random_token(rng, 256));
+        }
+
+        h2proto::WindowUpdateFrame *update = seq.add_frames()->mutable_window_update_frame();
+        update->set_window_size_increment(65535);
+
+        h2proto::PingFrame *ping = seq.add_frames()->mutable_ping_frame();
+        ping->set_opaque_data_lo(i);
+        ping->set_opaque_data_hi(0);
+        ping->set_ack(false);
+    }
+
+    return seq;
+}
+
+/* Full Encode<Sequence>, fresh context (connection) per iteration */
+static void BM_EncodeSequence(benchmark::State& state)
+{
+    h2proto::Sequence seq = synthetic_sequence(state.range(0));
+
+    EncodeBuffer out;
+    for (auto _ : state) {
+        EncodingContext ctx;
+        out.clear();
+        EncodeTo(seq, out, ctx);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * out.size());
+    state.SetItemsProcessed(state.iterations() * seq.frames_size());
+}
+BENCHMARK(BM_EncodeSequence)->ArgName("streams")->RangeMultiplier(4)->Range(1, 256);
+
+
+/* FrameIndex::scan over an encoded synthetic sequence */
+static void BM_ScanFrames(benchmark::State& state)
+{
+    EncodingContext ctx;
+    std::string wire = Encode(synthetic_sequence(state.range(0)), ctx);
+
+    for (auto _ : state) {
+        FrameIndex index;
+        index.scan(wire);
+        benchmark::DoNotOptimize(index.frames.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * wire.size());
+}
+BENCHMARK(BM_ScanFrames)->ArgName("streams")->RangeMultiplier(4)->Range(1, 256);
+
+
+/* Full FrameDecoder::decode of the same bytes, for comparison */
+static void BM_DecodeFrames(benchmark::State& state)
+{
+    EncodingContext ctx;
+    std::string wire = Encode(synthetic_sequence(state.range(0)), ctx);
+
+    for (auto _ : state) {
+        FrameDecoder decoder;
+        h2proto::Sequence seq;
+        decoder.decode(wire, &seq);
+        benchmark::DoNotOptimize(seq.frames_size());
+    }
+
+    state.SetBytesProcessed(state.iterations() * wire.size());
+}
+BENCHMARK(BM_DecodeFrames)->ArgName("streams")->RangeMultiplier(4)->Range(1, 256);
+
+
+/* Encode a one-exchange Conversation into ServerStub, as the conversation
+ * fuzzer does per input
+ */
+static void BM_ServerStubConversation(benchmark::State& state)
+{
+    h2proto::Conversation conversation;
+    *conversation.add_exchanges()->mutable_request_sequence() =
+            synthetic_sequence(state.range(0));
+
+    uint64_t bytes = 0;
+    for (auto _ : state) {
+        EncodingContext ctx;
+        ServerStubRun run = RunAgainstServerStub(conversation, ctx);
+        bytes += run.bytes_sent;
+    }
+
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_ServerStubConversation)->ArgName("streams")->RangeMultiplier(4)->Range(1, 256);
+
+
+struct SilentErrors : google::protobuf::io::ErrorCollector {
+    void AddError(int, int, const std::string&) override {}
+};
+
+/* Request sides of every Conversation under H2_BENCH_CORPUS, text or binary */
+static const std::vector<h2proto::Sequence>& pcap_corpus()
+{
+    static std::vector<h2proto::Sequence> corpus = [] {
+        std::vector<h2proto::Sequence> sequences;
+
+        const char *dir = getenv("H2_BENCH_CORPUS");
+        if (!dir)
+            return sequences;
+
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            std::ifstream file(entry.path(), std::ios::binary);
+            std::stringstream bytes;
+            bytes << file.rdbuf();
+
+            // Text first, as text protos can happen to parse as binary ones
+            h2proto::Conversation conversation;
+            SilentErrors errors;
+            google::protobuf::TextFormat::Parser parser;
+            parser.RecordErrorsTo(&errors);
+
+            if (!parser.ParseFromString(bytes.str(), &conversation) &&
+                    !conversation.ParseFromString(bytes.str()))
+                continue;
+
+            h2proto::Sequence seq;
+            for (const auto& exchange : conversation.exchanges())
+                seq.MergeFrom(exchange.request_sequence());
+            sequences.push_back(std::move(seq));
+        }
+
+        return sequences;
+    }();
+
+    return corpus;
+}
+
+static void BM_EncodeSequencePcap(benchmark::State& state)
+{
+    const auto& corpus = pcap_corpus();
+    if (corpus.empty()) {
+        state.SkipWithError("H2_BENCH_CORPUS not set or empty");
+        return;
+    }
+
+    size_t bytes = 0, frames = 0;
+    EncodeBuffer out;
+    for (auto _ : state) {
+        for (const auto& seq : corpus) {
+            EncodingContext ctx;
+            out.clear();
+            EncodeTo(seq, out, ctx);
+            benchmark::DoNotOptimize(out.data());
+
+            bytes += out.size();
+            frames += seq.frames_size();
+        }
+    }
+
+    state.SetBytesProcessed(bytes);
+    state.SetItemsProcessed(frames);
+}
+BENCHMARK(BM_EncodeSequencePcap);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+/* Unaligned big-endian loads and stores for frame headers and payloads */
+
+static inline uint32_t to_be32(uint32_t v)
+{
+    if constexpr (std::endian::native == std::endian::little)
+        return __builtin_bswap32(v);
+    return v;
+}
+
+static inline uint64_t to_be64(uint64_t v)
+{
+    if constexpr (std::endian::native == std::endian::little)
+        return __builtin_bswap64(v);
+    return v;
+}
+
+static inline uint16_t to_be16(uint16_t v)
+{
+    if constexpr (std::endian::native == std::endian::little)
+        return __builtin_bswap16(v);
+    return v;
+}
+
+static inline void store_be32(char *p, uint32_t v)
+{
+    v = to_be32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void store_be64(char *p, uint64_t v)
+{
+    v = to_be64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void store_be16(char *p, uint16_t v)
+{
+    v = to_be16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t load_be32(const void *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return to_be32(v);
+}
+
+static inline uint64_t load_be64(const void *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return to_be64(v);
+}
+
+static inline uint16_t load_be16(const void *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return to_be16(v);
+}
+
+static inline uint32_t load_be24(const void *p)
+{
+    const uint8_t *b = (const uint8_t *)p;
+    return b[0] << 16 | b[1] << 8 | b[2];
+}
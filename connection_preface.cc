@@ -0,0 +1,31 @@
+#include <string>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "connection_preface.h"
+#include "encoding_context.h"
+#include "protobuf_encoders.h"
+
+ConnectionPreface::ConnectionPreface(const PrefaceConfig& config)
+    : config(config)
+{
+    // SETTINGS and WINDOW_UPDATE are stateless, any context will do
+    EncodingContext scratch;
+    EncodeBuffer buf;
+
+    buf = config.magic;
+
+    if (config.send_settings) {
+        h2proto::SettingsFrame settings = config.settings;
+        settings.set_ack(false);
+        EncodeTo(settings, buf, scratch);
+    }
+
+    if (config.window_update) {
+        h2proto::WindowUpdateFrame update;
+        update.set_window_size_increment(config.window_update);
+        EncodeTo(update, buf, scratch);
+    }
+
+    bytes = buf;
+}
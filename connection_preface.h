@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+/* RFC 7540 3.5 */
+#define H2_CLIENT_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+/* What every connection starts with */
+struct PrefaceConfig {
+    std::string magic = H2_CLIENT_PREFACE;
+
+    // Initial SETTINGS, sent unless send_settings is false
+    bool send_settings = true;
+    h2proto::SettingsFrame settings;
+
+    // Connection-level WINDOW_UPDATE increment, 0 to skip
+    uint32_t window_update = 0;
+};
+
+/* A preface rendered once and shared read-only by every connection that uses
+ * the same config, e.g. through std::shared_ptr<const ConnectionPreface>.
+ */
+struct ConnectionPreface {
+    ConnectionPreface(const PrefaceConfig& config);
+
+    PrefaceConfig config;
+    std::string bytes;
+};
@@ -0,0 +1,281 @@
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "corpus_pack.h"
+#include "byte_order.h"
+
+static void store_header(char *p, uint32_t count, uint64_t index_offset)
+{
+    memcpy(p, CORPUS_PACK_MAGIC, 8);
+    store_be32(p + 8, count);
+    store_be32(p + 12, 0);
+    store_be64(p + 16, index_offset);
+}
+
+static bool load_header(const char *p, uint32_t *count, uint64_t *index_offset)
+{
+    if (memcmp(p, CORPUS_PACK_MAGIC, 8))
+        return false;
+
+    *count = load_be32(p + 8);
+    *index_offset = load_be64(p + 16);
+    return true;
+}
+
+CorpusPack::CorpusPack(const char *path)
+    : file(path, false)
+{
+    std::string_view data = file.data;
+
+    if (!file.ok || data.size() < CORPUS_PACK_HEADER_SIZE)
+        return;
+    if (!load_header(data.data(), &count, &index_offset))
+        return;
+
+    if (index_offset < CORPUS_PACK_HEADER_SIZE || index_offset > data.size() ||
+            (data.size() - index_offset) / 8 < count)
+        return;
+
+    index = data.data() + index_offset;
+    ok = true;
+}
+
+bool CorpusPack::locate(size_t i, std::string_view *bytes) const
+{
+    uint64_t offset = load_be64(index + 8 * i);
+
+    // Records always precede the index they are listed in
+    if (offset < CORPUS_PACK_HEADER_SIZE || offset > index_offset - 4)
+        return false;
+
+    uint32_t length = load_be32(file.data.data() + offset);
+    if (length > index_offset - offset - 4)
+        return false;
+
+    *bytes = file.data.substr(offset + 4, length);
+    return true;
+}
+
+std::string_view CorpusPack::record(size_t i) const
+{
+    std::string_view bytes;
+    locate(i, &bytes);
+    return bytes;
+}
+
+bool CorpusPack::load(size_t i, h2proto::Conversation *conversation) const
+{
+    std::string_view bytes;
+    return locate(i, &bytes) &&
+            conversation->ParseFromArray(bytes.data(), bytes.size());
+}
+
+static bool write_all(int fd, const char *p, size_t n, uint64_t offset)
+{
+    while (n) {
+        ssize_t written = pwrite(fd, p, n, offset);
+        if (written <= 0)
+            return false;
+
+        p += written;
+        n -= written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char *p, size_t n, uint64_t offset)
+{
+    while (n) {
+        ssize_t got = pread(fd, p, n, offset);
+        if (got <= 0)
+            return false;
+
+        p += got;
+        n -= got;
+        offset += got;
+    }
+    return true;
+}
+
+bool AppendToCorpusPack(const char *path,
+        const std::vector<std::string_view>& records)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    char header[CORPUS_PACK_HEADER_SIZE];
+    uint32_t count = 0;
+    uint64_t index_offset = 0;
+    uint64_t end = CORPUS_PACK_HEADER_SIZE;
+    std::string out;
+
+    bool ok = fstat(fd, &st) == 0;
+
+    // Start from the current index, unless this is a new pack
+    if (ok && st.st_size) {
+        ok = (uint64_t)st.st_size >= CORPUS_PACK_HEADER_SIZE &&
+                read_all(fd, header, sizeof(header), 0) &&
+                load_header(header, &count, &index_offset) &&
+                index_offset + 8 * (uint64_t)count <= (uint64_t)st.st_size;
+        end = st.st_size;
+    }
+
+    std::string index(8 * (size_t)count, '\0');
+    if (ok && count)
+        ok = read_all(fd, index.data(), index.size(), index_offset);
+
+    if (ok) {
+        for (std::string_view record : records) {
+            char offset[8], length[4];
+            store_be64(offset, end + out.size());
+            store_be32(length, record.size());
+
+            index.append(offset, sizeof(offset));
+            out.append(length, sizeof(length));
+            out.append(record);
+        }
+
+        count += records.size();
+        index_offset = end + out.size();
+        out.append(index);
+
+        // The header goes last, once the index it points at is on disk
+        store_header(header, count, index_offset);
+        ok = write_all(fd, out.data(), out.size(), end) &&
+                fdatasync(fd) == 0 &&
+                write_all(fd, header, sizeof(header), 0) &&
+                fdatasync(fd) == 0;
+    }
+
+    close(fd);
+    return ok;
+}
+
+long CompactCorpusPack(const char *path,
+        const std::function<bool(std::string_view)>& keep)
+{
+    CorpusPack pack(path);
+    if (!pack.ok)
+        return -1;
+
+    std::unordered_set<std::string_view> seen;
+    std::vector<std::string_view> kept;
+    h2proto::Conversation conversation;
+
+    for (size_t i = 0; i < pack.size(); i++) {
+        if (!pack.load(i, &conversation))
+            continue;
+
+        std::string_view record = pack.record(i);
+        if ((keep && !keep(record)) || !seen.insert(record).second)
+            continue;
+
+        kept.push_back(record);
+    }
+
+    std::string tmp = std::string(path) + ".tmp";
+    unlink(tmp.c_str());
+
+    if (!AppendToCorpusPack(tmp.c_str(), kept) || rename(tmp.c_str(), path)) {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return kept.size();
+}
+
+void CorpusPack::run_tests()
+{
+    std::string path = (std::filesystem::temp_directory_path() /
+            ("corpus_pack_test." + std::to_string(getpid()))).string();
+    unlink(path.c_str());
+
+    h2proto::Conversation conversation;
+    h2proto::Exchange *exchange = conversation.add_exchanges();
+    h2proto::PingFrame *ping = exchange->mutable_request_sequence()->add_frames()
+            ->mutable_ping_frame();
+    ping->set_opaque_data_lo(1);
+    ping->set_opaque_data_hi(0);
+    ping->set_ack(false);
+    exchange->mutable_response_sequence();
+    std::string first = conversation.SerializeAsString();
+
+    exchange->mutable_response_sequence()->add_frames()->mutable_ping_frame()
+            ->CopyFrom(*ping);
+    exchange->mutable_response_sequence()->mutable_frames(0)->mutable_ping_frame()
+            ->set_ack(true);
+    std::string second = conversation.SerializeAsString();
+
+    // A length-delimited field running past the end does not parse
+    std::string damaged = "\x0a\x7f";
+
+    // Append, then append again with a duplicate and a damaged record
+    {
+        assert(AppendToCorpusPack(path.c_str(), { first, second }));
+        assert(AppendToCorpusPack(path.c_str(), { first, damaged }));
+
+        CorpusPack pack(path.c_str());
+        assert(pack.ok && pack.size() == 4);
+        assert(pack.record(0) == first && pack.record(1) == second);
+        assert(pack.record(2) == first && pack.record(3) == damaged);
+        assert(pack.load(1, &conversation) && conversation.SerializeAsString() == second);
+        assert(!pack.load(3, &conversation));
+    }
+
+    // An append cut short leaves bytes past the index the header names
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+        assert(fd >= 0 && write(fd, "\0\0\0\x10partial", 11) == 11);
+        close(fd);
+
+        CorpusPack pack(path.c_str());
+        assert(pack.ok && pack.size() == 4 && pack.record(1) == second);
+    }
+
+    // Compaction drops the stale index, the duplicate, the damaged record
+    // and the partial append
+    {
+        assert(CompactCorpusPack(path.c_str()) == 2);
+
+        CorpusPack pack(path.c_str());
+        assert(pack.ok && pack.size() == 2);
+        assert(pack.record(0) == first && pack.record(1) == second);
+        assert(pack.file.data.size() == CORPUS_PACK_HEADER_SIZE +
+                4 + first.size() + 4 + second.size() + 2 * 8);
+    }
+
+    // Records keep rejects go too
+    {
+        auto keep = [&](std::string_view record) { return record != first; };
+        assert(CompactCorpusPack(path.c_str(), keep) == 1);
+
+        CorpusPack pack(path.c_str());
+        assert(pack.ok && pack.size() == 1 && pack.record(0) == second);
+    }
+
+    // Packs that are not packs
+    {
+        assert(!CorpusPack((path + ".missing").c_str()).ok);
+        assert(CompactCorpusPack((path + ".missing").c_str()) == -1);
+
+        int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+        assert(fd >= 0 && write(fd, "H2LPMPK0", 8) == 8);
+        close(fd);
+
+        assert(!CorpusPack(path.c_str()).ok);
+        assert(!AppendToCorpusPack(path.c_str(), { first }));
+    }
+
+    unlink(path.c_str());
+}
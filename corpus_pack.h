@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "frame_scanner.h"
+
+/* Single-file seed corpus.
+ *
+ *   header   "H2LPMPK1", u32 count, u32 reserved, u64 index offset
+ *   records  u32 length, serialized Conversation
+ *   index    count x u64 offset of each record
+ *
+ * Integers are big-endian like everything else on the wire. Opening a pack
+ * maps it and checks the header and index only; records are parsed when
+ * asked for. Appending writes the new records and a new index after the
+ * current end, syncs them, and only then switches the header to it, so an
+ * append cut short by a crash or power loss leaves the previous contents
+ * readable. The old index stays behind as garbage until the pack is
+ * compacted, which syncs the new pack before renaming it over the old one.
+ */
+static constexpr char CORPUS_PACK_MAGIC[] = "H2LPMPK1";
+static constexpr size_t CORPUS_PACK_HEADER_SIZE = 24;
+
+struct CorpusPack {
+    CorpusPack(const char *path);
+
+    size_t size() const { return count; }
+
+    /* Serialized record i, or an empty view if it lies outside the file */
+    std::string_view record(size_t i) const;
+
+    /* Parse record i; false if it is damaged */
+    bool load(size_t i, h2proto::Conversation *conversation) const;
+
+    MappedFile file;
+    bool ok = false;
+
+    static void run_tests();
+
+    private:
+    bool locate(size_t i, std::string_view *bytes) const;
+
+    const char *index = nullptr;
+    uint64_t index_offset = 0;
+    uint32_t count = 0;
+};
+
+/* Add serialized records to a pack, creating it if needed */
+bool AppendToCorpusPack(const char *path,
+        const std::vector<std::string_view>& records);
+
+/* Rewrite a pack without stale indexes, duplicate records, records that do
+ * not parse and, if keep is given, records it rejects. The new pack replaces
+ * the old one by rename. Returns the number of records kept, or -1.
+ */
+long CompactCorpusPack(const char *path,
+        const std::function<bool(std::string_view)>& keep = nullptr);
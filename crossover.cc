@@ -0,0 +1,370 @@
+#include <cassert>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "crossover.h"
+#include "sequence_repair.h"
+#include "protobuf_encoders.h"
+#include "frame_dispatch.h"
+
+typedef google::protobuf::RepeatedPtrField<h2proto::Frame> FrameList;
+typedef google::protobuf::RepeatedPtrField<h2proto::HeaderField> HeaderList;
+
+static uint32_t pick(std::minstd_rand& rng, size_t n)
+{
+    return rng() % n;
+}
+
+/* Index of the first frame of each unit, followed by frames.size() */
+static std::vector<int> unit_starts(const FrameList& frames)
+{
+    std::vector<int> starts;
+    bool in_block = false;
+
+    for (int i = 0; i < frames.size(); i++) {
+        const h2proto::Frame& frame = frames[i];
+
+        if (!(in_block && frame.has_continuation_frame()))
+            starts.push_back(i);
+
+        in_block = VisitFrame(frame, [](const auto& f) {
+            if constexpr (requires { f.end_headers(); })
+                return !f.end_headers();
+            else
+                return false;
+        });
+    }
+
+    starts.push_back(frames.size());
+    return starts;
+}
+
+static uint32_t highest_stream_id(const h2proto::Sequence& seq)
+{
+    uint32_t highest = 0;
+
+    for (const h2proto::Frame& frame : seq.frames()) {
+        VisitFrame(frame, [&](const auto& f) {
+            if constexpr (requires { f.stream_id(); })
+                highest = std::max(highest, f.stream_id());
+        });
+    }
+    return std::min(highest, MAX_INT_31);
+}
+
+static uint32_t highest_stream_id(const h2proto::Conversation& conversation)
+{
+    uint32_t highest = 0;
+
+    for (const h2proto::Exchange& exchange : conversation.exchanges()) {
+        highest = std::max({highest,
+                highest_stream_id(exchange.request_sequence()),
+                highest_stream_id(exchange.response_sequence())});
+    }
+    return highest;
+}
+
+/* New streams start at the first odd ID above highest */
+static StreamRenumbering transplant_streams(uint32_t highest)
+{
+    StreamRenumbering streams;
+    streams.next = highest < MAX_INT_31 ? (highest + 1) | 1 : MAX_INT_31;
+    return streams;
+}
+
+/* Stream 0 stays the connection; dependencies on streams outside the
+ * transplanted frames are kept as they are.
+ */
+static void renumber(h2proto::Frame *frame, StreamRenumbering& streams)
+{
+    VisitFrame(frame, [&](auto& f) {
+        if constexpr (requires { f.stream_id(); }) {
+            if (f.stream_id())
+                f.set_stream_id(streams.open(f.stream_id()));
+        }
+        if constexpr (requires { f.stream_dependency(); }) {
+            auto it = streams.ids.find(f.stream_dependency());
+            if (f.stream_dependency() && it != streams.ids.end())
+                f.set_stream_dependency(it->second);
+        }
+    });
+}
+
+static void renumber(h2proto::Sequence *seq, StreamRenumbering& streams)
+{
+    for (h2proto::Frame& frame : *seq->mutable_frames())
+        renumber(&frame, streams);
+}
+
+/* Streams of seq in order of first use, added to order */
+static void first_use(const h2proto::Sequence& seq, std::vector<uint32_t> *order,
+        std::unordered_set<uint32_t> *seen)
+{
+    for (const h2proto::Frame& frame : seq.frames()) {
+        VisitFrame(frame, [&](const auto& f) {
+            if constexpr (requires { f.stream_id(); }) {
+                if (f.stream_id() && seen->insert(f.stream_id()).second)
+                    order->push_back(f.stream_id());
+            }
+        });
+    }
+}
+
+/* Hand the IDs in use back out in order of first use, so that splicing
+ * never opens a lower stream after a higher one (RFC 7540 5.1.1)
+ */
+static StreamRenumbering in_order(const std::vector<uint32_t>& order)
+{
+    std::vector<uint32_t> sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+
+    StreamRenumbering streams;
+    for (size_t i = 0; i < order.size(); i++)
+        streams.ids[order[i]] = sorted[i];
+    return streams;
+}
+
+static void reorder_streams(h2proto::Sequence *child)
+{
+    std::vector<uint32_t> order;
+    std::unordered_set<uint32_t> seen;
+
+    first_use(*child, &order, &seen);
+    StreamRenumbering streams = in_order(order);
+    renumber(child, streams);
+}
+
+static void reorder_streams(h2proto::Conversation *child)
+{
+    std::vector<uint32_t> order;
+    std::unordered_set<uint32_t> seen;
+
+    for (const h2proto::Exchange& exchange : child->exchanges()) {
+        first_use(exchange.request_sequence(), &order, &seen);
+        first_use(exchange.response_sequence(), &order, &seen);
+    }
+
+    StreamRenumbering streams = in_order(order);
+    for (h2proto::Exchange& exchange : *child->mutable_exchanges()) {
+        renumber(exchange.mutable_request_sequence(), streams);
+        renumber(exchange.mutable_response_sequence(), streams);
+    }
+}
+
+/* Insert a run of units from donor at a unit boundary of frames, either
+ * next to the units already there or in place of some of them.
+ */
+static bool splice_frames(FrameList *frames, const FrameList& donor,
+        std::minstd_rand& rng, StreamRenumbering& streams)
+{
+    std::vector<int> donor_units = unit_starts(donor);
+    std::vector<int> units = unit_starts(*frames);
+    size_t num_donor_units = donor_units.size() - 1;
+    size_t num_units = units.size() - 1;
+
+    if (!num_donor_units)
+        return false;
+
+    size_t first = pick(rng, num_donor_units);
+    size_t last = first + 1 + pick(rng, num_donor_units - first);
+    size_t at = pick(rng, num_units + 1);
+    size_t replaced = pick(rng, 2) ? pick(rng, num_units - at + 1) : 0;
+
+    FrameList spliced;
+    spliced.Reserve(frames->size() + donor_units[last] - donor_units[first]);
+
+    for (int i = 0; i < units[at]; i++)
+        spliced.Add()->Swap(frames->Mutable(i));
+
+    for (int i = donor_units[first]; i < donor_units[last]; i++) {
+        h2proto::Frame *frame = spliced.Add();
+        *frame = donor[i];
+        renumber(frame, streams);
+    }
+
+    for (int i = units[at + replaced]; i < frames->size(); i++)
+        spliced.Add()->Swap(frames->Mutable(i));
+
+    frames->Swap(&spliced);
+    return true;
+}
+
+static HeaderList *header_list(h2proto::Frame *frame)
+{
+    return VisitFrame(frame, [](auto& f) -> HeaderList * {
+        if constexpr (requires { f.mutable_header_list(); })
+            return f.mutable_header_list();
+        else
+            return nullptr;
+    });
+}
+
+static const HeaderList *header_list(const h2proto::Frame& frame)
+{
+    return VisitFrame(frame, [](const auto& f) -> const HeaderList * {
+        if constexpr (requires { f.header_list(); })
+            return &f.header_list();
+        else
+            return nullptr;
+    });
+}
+
+/* Replace the header list of a frame with a non-empty one from donor */
+static bool transplant_headers(FrameList *frames, const FrameList& donor,
+        std::minstd_rand& rng)
+{
+    std::vector<HeaderList *> targets;
+    std::vector<const HeaderList *> sources;
+
+    for (h2proto::Frame& frame : *frames) {
+        if (HeaderList *list = header_list(&frame))
+            targets.push_back(list);
+    }
+    for (const h2proto::Frame& frame : donor) {
+        const HeaderList *list = header_list(frame);
+        if (list && list->size())
+            sources.push_back(list);
+    }
+
+    if (targets.empty() || sources.empty())
+        return false;
+
+    *targets[pick(rng, targets.size())] = *sources[pick(rng, sources.size())];
+    return true;
+}
+
+static void cross_frames(FrameList *frames, const FrameList& donor,
+        std::minstd_rand& rng, StreamRenumbering& streams)
+{
+    if (pick(rng, 2) && transplant_headers(frames, donor, rng))
+        return;
+    splice_frames(frames, donor, rng, streams);
+}
+
+void CrossOver(const h2proto::Sequence& a, const h2proto::Sequence& b,
+        unsigned int seed, h2proto::Sequence *child)
+{
+    std::minstd_rand rng(seed);
+    StreamRenumbering streams = transplant_streams(highest_stream_id(a));
+
+    *child = a;
+    cross_frames(child->mutable_frames(), b.frames(), rng, streams);
+    reorder_streams(child);
+}
+
+/* Insert a run of exchanges from b, optionally in place of some of child's */
+static void splice_exchanges(h2proto::Conversation *child,
+        const h2proto::Conversation& b, std::minstd_rand& rng,
+        StreamRenumbering& streams)
+{
+    auto *exchanges = child->mutable_exchanges();
+    size_t first = pick(rng, b.exchanges_size());
+    size_t last = first + 1 + pick(rng, b.exchanges_size() - first);
+    size_t at = pick(rng, exchanges->size() + 1);
+    size_t replaced = pick(rng, 2) ? pick(rng, exchanges->size() - at + 1) : 0;
+
+    google::protobuf::RepeatedPtrField<h2proto::Exchange> spliced;
+    spliced.Reserve(exchanges->size() + last - first);
+
+    for (size_t i = 0; i < at; i++)
+        spliced.Add()->Swap(exchanges->Mutable(i));
+
+    for (size_t i = first; i < last; i++) {
+        h2proto::Exchange *exchange = spliced.Add();
+        *exchange = b.exchanges(i);
+        renumber(exchange->mutable_request_sequence(), streams);
+        renumber(exchange->mutable_response_sequence(), streams);
+    }
+
+    for (size_t i = at + replaced; i < (size_t)exchanges->size(); i++)
+        spliced.Add()->Swap(exchanges->Mutable(i));
+
+    exchanges->Swap(&spliced);
+}
+
+void CrossOver(const h2proto::Conversation& a, const h2proto::Conversation& b,
+        unsigned int seed, h2proto::Conversation *child)
+{
+    std::minstd_rand rng(seed);
+    StreamRenumbering streams = transplant_streams(highest_stream_id(a));
+
+    *child = a;
+    if (!b.exchanges_size())
+        return;
+
+    // Exchange-level splices half the time, or when there is nothing to
+    // splice frames into
+    if (!child->exchanges_size() || pick(rng, 2)) {
+        splice_exchanges(child, b, rng, streams);
+    } else {
+        h2proto::Sequence *target = child->mutable_exchanges(
+                pick(rng, child->exchanges_size()))->mutable_request_sequence();
+        const h2proto::Sequence& donor =
+                b.exchanges(pick(rng, b.exchanges_size())).request_sequence();
+
+        cross_frames(target->mutable_frames(), donor.frames(), rng, streams);
+    }
+
+    reorder_streams(child);
+}
+
+/* First use of each stream comes in increasing ID order */
+static bool streams_in_order(const h2proto::Sequence& seq)
+{
+    std::vector<uint32_t> order;
+    std::unordered_set<uint32_t> seen;
+
+    first_use(seq, &order, &seen);
+    return std::is_sorted(order.begin(), order.end());
+}
+
+static void add_headers(h2proto::Sequence *seq, uint32_t stream_id)
+{
+    h2proto::HeadersFrame *headers = seq->add_frames()->mutable_headers_frame();
+    headers->set_stream_id(stream_id);
+    headers->set_end_headers(true);
+    headers->set_end_stream(true);
+}
+
+void RunCrossOverTests()
+{
+    h2proto::Sequence a, b;
+    for (uint32_t id : { 1, 3, 5 })
+        add_headers(&a, id);
+    for (uint32_t id : { 1, 3 })
+        add_headers(&b, id);
+
+    h2proto::Conversation conversation_a, conversation_b;
+    for (uint32_t id : { 1, 3, 5 })
+        add_headers(conversation_a.add_exchanges()->mutable_request_sequence(), id);
+    for (uint32_t id : { 1, 3 })
+        add_headers(conversation_b.add_exchanges()->mutable_request_sequence(), id);
+
+    // Transplanted streams land anywhere, but are opened in order
+    for (unsigned int seed = 0; seed < 200; seed++) {
+        h2proto::Sequence child;
+        CrossOver(a, b, seed, &child);
+        assert(streams_in_order(child));
+
+        h2proto::Conversation conversation;
+        CrossOver(conversation_a, conversation_b, seed, &conversation);
+
+        h2proto::Sequence requests;
+        for (const auto& exchange : conversation.exchanges())
+            requests.MergeFrom(exchange.request_sequence());
+        assert(streams_in_order(requests));
+    }
+
+    // The first parent's IDs are reused as they are when nothing is spliced
+    // before them
+    {
+        h2proto::Sequence child = a;
+        reorder_streams(&child);
+        assert(child.SerializePartialAsString() == a.SerializePartialAsString());
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+/* Structure-aware crossover.
+ * Children start as a copy of the first parent and take material from the
+ * second one in units that still mean something on the wire:
+ *
+ *  - whole exchanges (Conversation only)
+ *  - runs of frames, cut only between units, where a HEADERS or
+ *    PUSH_PROMISE frame and the CONTINUATIONs of its block count as one
+ *    unit, so HPACK blocks are never split
+ *  - header lists, swapped into a frame that carries one
+ *
+ * Stream IDs of transplanted frames are moved into the child's ID space:
+ * each stream of the second parent becomes a new odd stream above those the
+ * first parent uses, and dependencies move with them. The child's streams
+ * are then given the IDs in use in order of first use, so that wherever the
+ * new ones were spliced in, no stream is opened below an earlier one.
+ * seed picks the operation and cut points.
+ */
+void CrossOver(const h2proto::Sequence& a, const h2proto::Sequence& b,
+        unsigned int seed, h2proto::Sequence *child);
+
+void CrossOver(const h2proto::Conversation& a, const h2proto::Conversation& b,
+        unsigned int seed, h2proto::Conversation *child);
+
+void RunCrossOverTests();
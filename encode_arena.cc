@@ -0,0 +1,51 @@
+#include <new>
+#include <sys/mman.h>
+
+#include "encode_arena.h"
+
+#define HUGE_PAGE_SIZE (2 << 20)
+
+static void *map_slab(size_t& size, bool& huge_pages)
+{
+    void *slab = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (huge_pages) {
+        size_t rounded = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+        slab = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (slab != MAP_FAILED)
+            size = rounded;
+    }
+#endif
+
+    // No reserved huge pages; fall back to (maybe transparent) huge pages
+    if (slab == MAP_FAILED) {
+        huge_pages = false;
+        slab = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED)
+            throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+        madvise(slab, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    return slab;
+}
+
+EncodeArena::EncodeArena(size_t slab_size, bool huge_pages,
+        std::pmr::memory_resource *upstream)
+    : slab(map_slab(slab_size, huge_pages)),
+      slab_size(slab_size),
+      huge_pages(huge_pages),
+      monotonic(slab, slab_size, upstream)
+{
+}
+
+EncodeArena::~EncodeArena()
+{
+    monotonic.release();
+    munmap(slab, slab_size);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+/* Per-input bump allocator for encoder output and temporaries.
+ * Allocations come out of one reusable slab (optionally on huge pages) and
+ * spill to the upstream resource when it runs out. reset() frees everything
+ * at once, so it must only be called once every EncodingContext and
+ * EncodeBuffer using resource() is gone.
+ *
+ *     EncodeArena arena;
+ *     for (each input) {
+ *         {
+ *             EncodingContext ctx(arena.resource());
+ *             EncodeBuffer out(arena.resource());
+ *             EncodeTo(conversation, out, ctx);
+ *             deliver(out);
+ *         }
+ *         arena.reset();
+ *     }
+ */
+struct EncodeArena {
+    EncodeArena(size_t slab_size = 1 << 20, bool huge_pages = false,
+            std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+    ~EncodeArena();
+
+    EncodeArena(const EncodeArena&) = delete;
+    EncodeArena& operator=(const EncodeArena&) = delete;
+
+    std::pmr::memory_resource *resource() { return &monotonic; }
+    void reset() { monotonic.release(); }
+
+    void *slab;
+    size_t slab_size;
+    bool huge_pages;
+
+    private:
+    std::pmr::monotonic_buffer_resource monotonic;
+};
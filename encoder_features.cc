@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "encoder_features.h"
+#include "priority_tree.h"
+
+/* FrameOneofCase values 0 (unset) to 10 */
+#define FEATURE_FRAME_CASES 11
+
+/* Counter regions, each a few buckets of one feature */
+enum {
+    HPACK_FILL = 0,                                 // 16ths of the table
+    HPACK_EVICTIONS = HPACK_FILL + 17,              // per insert, log2
+    HUFFMAN = HPACK_EVICTIONS + 8,                  // log2 length x pad bits
+    FRAME_BIGRAMS = HUFFMAN + 8 * 8,
+    TABLE_SIZE = FRAME_BIGRAMS + FEATURE_FRAME_CASES * FEATURE_FRAME_CASES,
+    STREAM_TRANSITIONS = TABLE_SIZE + 5 * 4,        // StreamState x StreamState
+    FLOW = STREAM_TRANSITIONS + 4 * 4,
+    PRIORITY_DEPTH = FLOW + FEATURE_FLOW_HITS,      // log2
+    PRIORITY_FAN_OUT = PRIORITY_DEPTH + 8,          // log2
+    PRIORITY_ADOPTED = PRIORITY_FAN_OUT + 8,        // log2
+    PRIORITY_CYCLE = PRIORITY_ADOPTED + 8,
+    PRIORITY_SELF_DEPENDENCY,
+    FEATURE_COUNTERS
+};
+
+__attribute__((used, section("__libfuzzer_extra_counters")))
+static uint8_t counters[FEATURE_COUNTERS];
+
+/* libFuzzer buckets counts itself (1, 2, 3, 4-7, ...), so counting more
+ * than once per input is worth it
+ */
+static void hit(int counter)
+{
+    if (counters[counter] != 255)
+        counters[counter]++;
+}
+
+/* 0 for 0, then 1 + floor(log2(value)), capped at classes - 1 */
+static int log2_class(uint64_t value, int classes)
+{
+    return std::min((int)std::bit_width(value), classes - 1);
+}
+
+void feature_hpack_insert(uint32_t table_size, uint32_t max_table_size,
+        uint32_t evicted)
+{
+    uint32_t fill = max_table_size ? (uint64_t)table_size * 16 / max_table_size : 16;
+
+    hit(HPACK_FILL + std::min(fill, (uint32_t)16));
+    hit(HPACK_EVICTIONS + log2_class(evicted, 8));
+}
+
+/* Huffman codes end on any bit, and the padding to the next byte is where
+ * decoders differ
+ */
+void feature_huffman_string(uint64_t bit_len)
+{
+    hit(HUFFMAN + log2_class(bit_len / 8, 8) * 8 + bit_len % 8);
+}
+
+void feature_frame(FeatureState& state, int oneof_case)
+{
+    if (oneof_case < 0 || oneof_case >= FEATURE_FRAME_CASES)
+        return;
+
+    hit(FRAME_BIGRAMS + state.last_frame_case * FEATURE_FRAME_CASES + oneof_case);
+    state.last_frame_case = oneof_case;
+}
+
+/* Each SETTINGS_HEADER_TABLE_SIZE we send makes the peer's encoder emit
+ * dynamic table size updates, so the sequence of values is what counts
+ */
+void feature_table_size(FeatureState& state, uint32_t size)
+{
+    int kind = !size ? 0 :
+            size > (1 << 20) ? 4 :
+            size < state.header_table_size ? 1 :
+            size == state.header_table_size ? 2 : 3;
+
+    state.table_size_changes += size != state.header_table_size;
+    state.header_table_size = size;
+
+    hit(TABLE_SIZE + kind * 4 + std::min(state.table_size_changes, (uint32_t)3));
+}
+
+void feature_stream_transition(int from, int to)
+{
+    if (from >= 0 && from < 4 && to >= 0 && to < 4)
+        hit(STREAM_TRANSITIONS + from * 4 + to);
+}
+
+void feature_flow(FeatureFlowHit flow_hit)
+{
+    hit(FLOW + (int)flow_hit);
+}
+
+void feature_priority(const PriorityReport& report)
+{
+    if (report.self_dependency) {
+        hit(PRIORITY_SELF_DEPENDENCY);
+        return;
+    }
+
+    hit(PRIORITY_DEPTH + log2_class(report.depth, 8));
+    hit(PRIORITY_FAN_OUT + log2_class(report.fan_out, 8));
+    hit(PRIORITY_ADOPTED + log2_class(report.adopted, 8));
+    if (report.cycle)
+        hit(PRIORITY_CYCLE);
+}
+
+const uint8_t *feature_counters(size_t *count)
+{
+    *count = FEATURE_COUNTERS;
+    return counters;
+}
+
+void feature_reset()
+{
+    memset(counters, 0, sizeof(counters));
+}
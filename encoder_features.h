@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Encoder state exported to libFuzzer as extra coverage counters.
+ * Build fuzzers with -DH2_FUZZ_FEATURES to compile the hooks into the
+ * encoders and models; without it FEATURE() expands to nothing. The
+ * counters live in the __libfuzzer_extra_counters section, which libFuzzer
+ * clears before every input and scans like its own coverage. An input that
+ * drives the encoder into a new state (a fuller HPACK table, a longer
+ * eviction cascade, an unseen pair of frame types, ...) is kept even when
+ * the target's coverage does not change. The counters are plain bytes, so
+ * encode on one thread only.
+ */
+#ifdef H2_FUZZ_FEATURES
+#define FEATURE(STMT) STMT
+#else
+#define FEATURE(STMT)
+#endif
+
+struct PriorityReport;
+
+/* Per-connection history some features depend on, kept in EncodingContext */
+struct FeatureState {
+    int last_frame_case = 0;
+    uint32_t header_table_size = 4096;
+    uint32_t table_size_changes = 0;
+};
+
+/* Window conditions after a DATA, SETTINGS or WINDOW_UPDATE frame */
+enum FeatureFlowHit {
+    FEATURE_FLOW_STREAM_EXHAUSTED,
+    FEATURE_FLOW_STREAM_NEGATIVE,
+    FEATURE_FLOW_CONNECTION_EXHAUSTED,
+    FEATURE_FLOW_CONNECTION_NEGATIVE,
+    FEATURE_FLOW_OVER_WINDOW,
+    FEATURE_FLOW_SETTINGS_NEGATIVE,
+    FEATURE_FLOW_RECEIVE_OVERFLOW,
+    FEATURE_FLOW_ZERO_INCREMENT,
+    FEATURE_FLOW_HITS
+};
+
+void feature_hpack_insert(uint32_t table_size, uint32_t max_table_size,
+        uint32_t evicted);
+void feature_huffman_string(uint64_t bit_len);
+void feature_frame(FeatureState& state, int oneof_case);
+void feature_table_size(FeatureState& state, uint32_t size);
+void feature_stream_transition(int from, int to);
+void feature_flow(FeatureFlowHit hit);
+void feature_priority(const PriorityReport& report);
+
+/* The counter bytes, for drivers other than libFuzzer */
+const uint8_t *feature_counters(size_t *count);
+void feature_reset();
@@ -0,0 +1,209 @@
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "encoder_telemetry.h"
+#include "frame_dispatch.h"
+
+/* Live threads register their counters here. Exiting threads fold theirs
+ * into retired so nothing is lost.
+ */
+struct TelemetryRegistry {
+    std::mutex lock;
+    std::vector<TelemetryCounters *> live;
+    TelemetryCounters retired = {};
+};
+
+static TelemetryRegistry& registry()
+{
+    static TelemetryRegistry *instance = new TelemetryRegistry;
+    return *instance;
+}
+
+struct ThreadTelemetry {
+    TelemetryCounters counters = {};
+
+    ThreadTelemetry() {
+        std::lock_guard<std::mutex> guard(registry().lock);
+        registry().live.push_back(&counters);
+    }
+
+    ~ThreadTelemetry() {
+        TelemetryRegistry& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.retired.merge(counters);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &counters));
+    }
+};
+
+static TelemetryCounters& local()
+{
+    thread_local ThreadTelemetry telemetry;
+    return telemetry.counters;
+}
+
+void TelemetryCounters::merge(const TelemetryCounters& other)
+{
+    for (int i = 0; i < TELEMETRY_FRAME_CASES; i++) {
+        frames[i].count += other.frames[i].count;
+        frames[i].bytes += other.frames[i].bytes;
+        for (int j = 0; j < TELEMETRY_CYCLE_BUCKETS; j++)
+            frames[i].cycles[j] += other.frames[i].cycles[j];
+    }
+
+    hpack_indexed += other.hpack_indexed;
+    hpack_name_indexed += other.hpack_name_indexed;
+    hpack_literal += other.hpack_literal;
+    hpack_table_inserts += other.hpack_table_inserts;
+    hpack_evictions += other.hpack_evictions;
+
+    huffman_strings += other.huffman_strings;
+    huffman_bytes += other.huffman_bytes;
+    raw_strings += other.raw_strings;
+    raw_bytes += other.raw_bytes;
+}
+
+uint64_t telemetry_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+void telemetry_frame(int oneof_case, uint64_t bytes, uint64_t cycles)
+{
+    if (oneof_case < 0 || oneof_case >= TELEMETRY_FRAME_CASES)
+        return;
+
+    TelemetryCounters::FrameStats& stats = local().frames[oneof_case];
+    int bucket = cycles ? 63 - __builtin_clzll(cycles) : 0;
+
+    stats.count++;
+    stats.bytes += bytes;
+    stats.cycles[std::min(bucket, TELEMETRY_CYCLE_BUCKETS - 1)]++;
+}
+
+void telemetry_hpack_hit(TelemetryHpackHit hit, bool table_insert)
+{
+    TelemetryCounters& c = local();
+
+    switch (hit) {
+        case TELEMETRY_HPACK_INDEXED: c.hpack_indexed++; break;
+        case TELEMETRY_HPACK_NAME_INDEXED: c.hpack_name_indexed++; break;
+        case TELEMETRY_HPACK_LITERAL: c.hpack_literal++; break;
+    }
+
+    c.hpack_table_inserts += table_insert;
+}
+
+void telemetry_hpack_evictions(uint64_t count)
+{
+    local().hpack_evictions += count;
+}
+
+void telemetry_string(bool huffman, uint64_t bytes)
+{
+    TelemetryCounters& c = local();
+
+    if (huffman) {
+        c.huffman_strings++;
+        c.huffman_bytes += bytes;
+    } else {
+        c.raw_strings++;
+        c.raw_bytes += bytes;
+    }
+}
+
+TelemetryCounters telemetry_snapshot()
+{
+    TelemetryRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    TelemetryCounters total = r.retired;
+    for (auto counters : r.live)
+        total.merge(*counters);
+
+    return total;
+}
+
+void telemetry_reset()
+{
+    TelemetryRegistry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    r.retired = {};
+    for (auto counters : r.live)
+        *counters = {};
+}
+
+void telemetry_dump(FILE *out)
+{
+    TelemetryCounters c = telemetry_snapshot();
+
+    fprintf(out, "{\n  \"frames\": {");
+    bool first = true;
+    for (int i = 1; i < TELEMETRY_FRAME_CASES; i++) {
+        const TelemetryCounters::FrameStats& stats = c.frames[i];
+
+        // Trim the histogram to its last used bucket
+        int buckets = TELEMETRY_CYCLE_BUCKETS;
+        while (buckets && !stats.cycles[buckets - 1]) buckets--;
+
+        fprintf(out, "%s\n    \"%s\": { \"count\": %lu, \"bytes\": %lu, "
+                "\"cycles_log2\": [", first ? "" : ",",
+                frame_type_names[frame_type_ids[i]],
+                (unsigned long)stats.count, (unsigned long)stats.bytes);
+        for (int j = 0; j < buckets; j++)
+            fprintf(out, "%s%lu", j ? ", " : "", (unsigned long)stats.cycles[j]);
+        fprintf(out, "] }");
+
+        first = false;
+    }
+    fprintf(out, "\n  },\n");
+
+    fprintf(out, "  \"hpack\": { \"indexed\": %lu, \"name_indexed\": %lu, "
+            "\"literal\": %lu, \"table_inserts\": %lu, \"evictions\": %lu },\n",
+            (unsigned long)c.hpack_indexed, (unsigned long)c.hpack_name_indexed,
+            (unsigned long)c.hpack_literal, (unsigned long)c.hpack_table_inserts,
+            (unsigned long)c.hpack_evictions);
+
+    uint64_t strings = c.huffman_strings + c.raw_strings;
+    fprintf(out, "  \"strings\": { \"huffman\": %lu, \"huffman_bytes\": %lu, "
+            "\"raw\": %lu, \"raw_bytes\": %lu, \"huffman_share\": %.4f }\n}\n",
+            (unsigned long)c.huffman_strings, (unsigned long)c.huffman_bytes,
+            (unsigned long)c.raw_strings, (unsigned long)c.raw_bytes,
+            strings ? (double)c.huffman_strings / strings : 0.0);
+}
+
+#ifdef H2_ENCODER_TELEMETRY
+static void telemetry_dump_at_exit()
+{
+    const char *path = getenv("H2_TELEMETRY_OUT");
+    if (!path)
+        return;
+
+    if (!strcmp(path, "-")) {
+        telemetry_dump(stderr);
+        return;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (out) {
+        telemetry_dump(out);
+        fclose(out);
+    }
+}
+
+static int telemetry_atexit = atexit(telemetry_dump_at_exit);
+#endif
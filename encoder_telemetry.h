@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+/* Optional encoder instrumentation.
+ * Build with -DH2_ENCODER_TELEMETRY to compile the hooks into the encoders
+ * and HPACK compressor; without it TELEMETRY() expands to nothing. Counters
+ * are thread-local and summed when dumped, either on demand through
+ * telemetry_dump() or at exit when H2_TELEMETRY_OUT names a file ("-" for
+ * stderr). Snapshots and resets may run while other threads are encoding.
+ */
+#ifdef H2_ENCODER_TELEMETRY
+#define TELEMETRY(STMT) STMT
+#else
+#define TELEMETRY(STMT)
+#endif
+
+/* log2(cycles) buckets */
+#define TELEMETRY_CYCLE_BUCKETS 32
+
+/* FrameOneofCase values 0 (unset) to 10 */
+#define TELEMETRY_FRAME_CASES 11
+
+/* One counter. Only its own thread adds to it, but snapshots read it and
+ * resets zero it from other threads, so it is a relaxed atomic. Copies load
+ * the current value.
+ */
+struct TelemetryCounter {
+    std::atomic<uint64_t> value { 0 };
+
+    TelemetryCounter() = default;
+    TelemetryCounter(const TelemetryCounter& other) : value(other) {}
+    TelemetryCounter& operator=(const TelemetryCounter& other) {
+        value.store(other, std::memory_order_relaxed);
+        return *this;
+    }
+
+    void operator+=(uint64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    void operator++(int) { *this += 1; }
+    operator uint64_t() const { return value.load(std::memory_order_relaxed); }
+};
+
+struct TelemetryCounters {
+    struct FrameStats {
+        TelemetryCounter count;
+        TelemetryCounter bytes;
+        TelemetryCounter cycles[TELEMETRY_CYCLE_BUCKETS];
+    };
+    FrameStats frames[TELEMETRY_FRAME_CASES];
+
+    /* HPACK representations chosen by the compressor */
+    TelemetryCounter hpack_indexed;
+    TelemetryCounter hpack_name_indexed;
+    TelemetryCounter hpack_literal;
+    TelemetryCounter hpack_table_inserts;
+    TelemetryCounter hpack_evictions;
+
+    /* HPackString encodings */
+    TelemetryCounter huffman_strings;
+    TelemetryCounter huffman_bytes;
+    TelemetryCounter raw_strings;
+    TelemetryCounter raw_bytes;
+
+    void merge(const TelemetryCounters& other);
+};
+
+enum TelemetryHpackHit {
+    TELEMETRY_HPACK_INDEXED,
+    TELEMETRY_HPACK_NAME_INDEXED,
+    TELEMETRY_HPACK_LITERAL
+};
+
+uint64_t telemetry_clock();
+void telemetry_frame(int oneof_case, uint64_t bytes, uint64_t cycles);
+void telemetry_hpack_hit(TelemetryHpackHit hit, bool table_insert);
+void telemetry_hpack_evictions(uint64_t count);
+void telemetry_string(bool huffman, uint64_t bytes);
+
+/* Sum of every thread's counters, including threads that have exited */
+TelemetryCounters telemetry_snapshot();
+void telemetry_reset();
+void telemetry_dump(FILE *out);
@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <string>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "encoding_context.h"
+
+/* Global encoding context */
+EncodingContext default_encoding_context;
+
+/* Global HPACK instance (kept for older harnesses) */
+HPackCompressor &hpack_compressor = default_encoding_context.hpack;
+
+void EncodingContext::apply_peer_settings(const h2proto::SettingsFrame& settings)
+{
+    if (settings.ack())
+        return;
+
+    // Out of range values are a connection error for the peer, so just clamp
+    if (settings.has_max_frame_size()) {
+        peer_max_frame_size = std::clamp(settings.max_frame_size(),
+                (uint32_t)H2_DEFAULT_MAX_FRAME_SIZE,
+                (uint32_t)H2_MAX_MAX_FRAME_SIZE);
+    }
+
+    flow.apply_peer_settings(settings);
+
+    if (settings.has_max_concurrent_streams())
+        streams.peer_max_concurrent_streams = settings.max_concurrent_streams();
+}
+
+void EncodingContext::write_preface(EncodeBuffer& out)
+{
+    if (preface_sent)
+        return;
+
+    preface_sent = true;
+
+    if (!preface) {
+        out += H2_CLIENT_PREFACE;
+        return;
+    }
+
+    out += preface->bytes;
+
+    // The preface skipped the Frame encoder, so account for its frames here.
+    // Neither is a stream frame, so the stream model has nothing to do.
+    const PrefaceConfig& config = preface->config;
+
+    if (config.send_settings) {
+        FEATURE(feature_frame(features, h2proto::Frame::kSettingsFrame));
+        FEATURE(if (config.settings.has_header_table_size())
+                feature_table_size(features, config.settings.header_table_size()));
+    }
+
+    if (config.window_update) {
+        FEATURE(feature_frame(features, h2proto::Frame::kWindowUpdateFrame));
+        flow.local_window_update(config.window_update);
+    }
+}
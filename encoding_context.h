@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+#include "hpack_compressor.h"
+#include "response_matcher.h"
+#include "connection_preface.h"
+#include "stream_states.h"
+#include "flow_control.h"
+#include "priority_tree.h"
+#include "encoder_features.h"
+
+/* RFC 7540 6.5.2 */
+#define H2_DEFAULT_MAX_FRAME_SIZE 16384
+#define H2_MAX_MAX_FRAME_SIZE ((1 << 24) - 1)
+
+/* How HEADERS/DATA payloads are fitted to the peer's SETTINGS_MAX_FRAME_SIZE */
+struct FramingPolicy {
+    // Split oversized header blocks into CONTINUATIONs and DATA into chunks
+    bool fragment = true;
+
+    // Let every fragment overshoot the limit by this many bytes
+    uint32_t violate_by = 0;
+};
+
+/* Per-connection encoder state.
+ * Everything that must stay consistent across the frames of one HTTP/2
+ * connection lives here, so independent connections can be encoded with
+ * independent contexts.
+ */
+struct EncodingContext {
+    EncodingContext(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : hpack(memory), memory(memory), streams(memory),
+          flow(memory), priorities(memory) {}
+
+    HPackCompressor hpack;
+
+    /* Backs encoder output and temporaries. With a per-input arena the
+     * context must be destroyed before the arena is reset.
+     */
+    std::pmr::memory_resource *memory;
+
+    FramingPolicy framing;
+    uint32_t peer_max_frame_size = H2_DEFAULT_MAX_FRAME_SIZE;
+
+    /* Stream states of the frames encoded so far. Consulted by the Frame
+     * encoder only, so frames encoded on their own are not tracked.
+     */
+    StreamTracker streams;
+
+    /* Flow-control windows, consulted by the DATA and WINDOW_UPDATE
+     * encoders
+     */
+    FlowControl flow;
+
+    /* Priority tree of the frames encoded so far, if tracked. Like streams,
+     * updated by the Frame encoder only.
+     */
+    PriorityTree priorities;
+
+    /* History for the coverage features of encoder_features.h */
+    FeatureState features;
+
+    /* Prefix for the connection. Without one, only the bare client preface
+     * magic is sent.
+     */
+    std::shared_ptr<const ConnectionPreface> preface;
+    bool preface_sent = false;
+
+    /* One matcher per encoded Exchange, oldest first. Drivers that pace
+     * exchanges pop these; others can simply clear them.
+     */
+    std::deque<ResponseMatcher> pending_responses;
+
+    /* Track settings advertised by the peer (not the ones we send) */
+    void apply_peer_settings(const h2proto::SettingsFrame& settings);
+
+    /* Write the connection preface unless it has already been sent */
+    void write_preface(EncodeBuffer& out);
+
+    /* Largest payload a single HEADERS/DATA fragment may carry. The 24 bit
+     * length field cannot describe more, however far the policy overshoots.
+     */
+    uint32_t frame_size_limit() const {
+        uint64_t limit = (uint64_t)peer_max_frame_size + framing.violate_by;
+        return std::clamp(limit, (uint64_t)1, (uint64_t)H2_MAX_MAX_FRAME_SIZE);
+    }
+};
+
+/* Used by Encode() when no context is passed */
+extern EncodingContext default_encoding_context;
@@ -0,0 +1,149 @@
+#include <algorithm>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "flow_control.h"
+#include "protobuf_encoders.h"
+#include "encoder_features.h"
+
+/* Flow control counts the whole DATA payload, Pad Length and padding too */
+static int64_t padding_size(const h2proto::DataFrame& frame)
+{
+    return frame.has_pad_length() ? 1 + std::min(frame.pad_length(), (uint32_t)255) : 0;
+}
+
+int64_t FlowControl::stream_send_window(uint32_t stream_id) const
+{
+    auto it = stream_send_windows.find(stream_id);
+    return it != stream_send_windows.end() ? it->second : peer_initial_window;
+}
+
+int64_t FlowControl::available(uint32_t stream_id) const
+{
+    return std::max(std::min(send_window, stream_send_window(stream_id)), (int64_t)0);
+}
+
+void FlowControl::apply_peer_settings(const h2proto::SettingsFrame& settings)
+{
+    if (settings.ack() || !settings.has_initial_window_size())
+        return;
+
+    // Larger values are a FLOW_CONTROL_ERROR for the peer, so just clamp
+    int64_t initial = std::min((int64_t)settings.initial_window_size(), H2_MAX_WINDOW_SIZE);
+    int64_t delta = initial - peer_initial_window;
+
+    // Open streams move by the difference (6.9.2); the connection does not
+    for (auto& [id, window] : stream_send_windows) {
+        window += delta;
+        FEATURE(if (window < 0) feature_flow(FEATURE_FLOW_SETTINGS_NEGATIVE));
+    }
+
+    peer_initial_window = initial;
+}
+
+void FlowControl::peer_window_update(uint32_t increment)
+{
+    send_window += std::min(increment, MAX_INT_31);
+}
+
+const h2proto::DataFrame& FlowControl::apply(const h2proto::DataFrame& frame)
+{
+    if (policy.data == FlowPolicy::UNTRACKED)
+        return frame;
+
+    const h2proto::DataFrame *sent = &frame;
+    int64_t window = available(frame.stream_id());
+    int64_t padding = padding_size(frame);
+    int64_t payload = frame.data().size() + padding;
+    int64_t target = payload;
+
+    switch (policy.data) {
+    case FlowPolicy::CLAMP:
+        target = std::min(payload, window);
+        break;
+    case FlowPolicy::BOUNDARY:
+        target = window;
+        break;
+    case FlowPolicy::EXCEED:
+        target = window + policy.exceed_by;
+        break;
+    default:
+        break;
+    }
+
+    // Zero fill is bounded, so huge windows are left alone when growing
+    if (target != payload && target - payload <= policy.max_fill) {
+        resized_data = frame;
+
+        // Padding goes first if it does not fit on its own
+        if (target < padding) {
+            resized_data.clear_pad_length();
+            padding = 0;
+        }
+        resized_data.mutable_data()->resize(target - padding, '\0');
+
+        sent = &resized_data;
+        payload = target;
+        resized++;
+    }
+
+    over_window += payload > window;
+
+    send_window -= payload;
+    int64_t& stream_window = stream_send_windows.try_emplace(frame.stream_id(),
+            peer_initial_window).first->second;
+    stream_window -= payload;
+
+    FEATURE(
+        if (payload > window) feature_flow(FEATURE_FLOW_OVER_WINDOW);
+        if (!stream_window) feature_flow(FEATURE_FLOW_STREAM_EXHAUSTED);
+        if (stream_window < 0) feature_flow(FEATURE_FLOW_STREAM_NEGATIVE);
+        if (!send_window) feature_flow(FEATURE_FLOW_CONNECTION_EXHAUSTED);
+        if (send_window < 0) feature_flow(FEATURE_FLOW_CONNECTION_NEGATIVE);
+    )
+
+    return *sent;
+}
+
+const h2proto::WindowUpdateFrame& FlowControl::apply(
+        const h2proto::WindowUpdateFrame& frame)
+{
+    if (policy.data == FlowPolicy::UNTRACKED && !policy.overflow_window)
+        return frame;
+
+    const h2proto::WindowUpdateFrame *sent = &frame;
+    uint32_t increment = std::min(frame.window_size_increment(), MAX_INT_31);
+
+    if (policy.overflow_window && !window_overflows &&
+            receive_window + increment <= H2_MAX_WINDOW_SIZE) {
+        increment = std::min(H2_MAX_WINDOW_SIZE - receive_window + policy.exceed_by,
+                H2_MAX_WINDOW_SIZE);
+
+        resized_update = frame;
+        resized_update.set_window_size_increment(increment);
+        sent = &resized_update;
+        resized++;
+    }
+
+    local_window_update(increment);
+    return *sent;
+}
+
+void FlowControl::local_window_update(uint32_t increment)
+{
+    increment = std::min(increment, MAX_INT_31);
+
+    // Both are errors for the peer (6.9, 6.9.1). An overflow is counted
+    // when the window crosses 2^31-1, not for every update after that.
+    bool overflowed = receive_window > H2_MAX_WINDOW_SIZE;
+
+    zero_increments += !increment;
+    receive_window += increment;
+    window_overflows += !overflowed && receive_window > H2_MAX_WINDOW_SIZE;
+
+    FEATURE(
+        if (!increment) feature_flow(FEATURE_FLOW_ZERO_INCREMENT);
+        if (receive_window > H2_MAX_WINDOW_SIZE) feature_flow(FEATURE_FLOW_RECEIVE_OVERFLOW);
+    )
+}
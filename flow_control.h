@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_map>
+
+/* RFC 7540 6.9.1, 6.9.2 */
+#define H2_DEFAULT_WINDOW_SIZE 65535
+#define H2_MAX_WINDOW_SIZE ((int64_t)0x7fffffff)
+
+/* What the DATA and WINDOW_UPDATE encoders do with the windows */
+struct FlowPolicy {
+    enum Mode {
+        UNTRACKED,  // encode DATA as given and keep no windows
+        OBSERVE,    // track windows and count DATA that does not fit
+        CLAMP,      // cut DATA down to the window
+        BOUNDARY,   // cut or zero-fill DATA so it uses the window exactly
+        EXCEED      // size DATA to overshoot the window by exceed_by bytes
+    } data = UNTRACKED;
+
+    uint32_t exceed_by = 1;
+
+    // Most zero bytes BOUNDARY and EXCEED may add to one DATA frame
+    int64_t max_fill = 1 << 20;
+
+    // Raise the first WINDOW_UPDATE that would not overflow our receive
+    // window so that it goes past 2^31-1 by exceed_by
+    bool overflow_window = false;
+};
+
+/* Send and receive windows of one connection (RFC 7540 6.9).
+ * Send windows are the peer's: they start at its SETTINGS_INITIAL_WINDOW_SIZE,
+ * shrink with every DATA payload we send (padding included) and grow with
+ * the WINDOW_UPDATEs in response sequences. A new initial window size moves
+ * every stream window by the difference, which can leave them negative.
+ * The receive window is ours, grown by the WINDOW_UPDATEs we send; those are
+ * connection-level only in the grammar.
+ */
+struct FlowControl {
+    FlowControl(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : stream_send_windows(memory) {}
+
+    int64_t stream_send_window(uint32_t stream_id) const;
+
+    /* Bytes of DATA payload stream_id may send right now, never negative */
+    int64_t available(uint32_t stream_id) const;
+
+    void apply_peer_settings(const h2proto::SettingsFrame& settings);
+    void peer_window_update(uint32_t increment);
+
+    /* Credit the receive window for a WINDOW_UPDATE sent outside the
+     * encoders, such as the one in a prerendered preface
+     */
+    void local_window_update(uint32_t increment);
+
+    /* Apply the policy to a frame about to be encoded and account for it.
+     * Returns frame itself or a resized copy.
+     */
+    const h2proto::DataFrame& apply(const h2proto::DataFrame& frame);
+    const h2proto::WindowUpdateFrame& apply(const h2proto::WindowUpdateFrame& frame);
+
+    FlowPolicy policy;
+
+    int64_t send_window = H2_DEFAULT_WINDOW_SIZE;
+    int64_t peer_initial_window = H2_DEFAULT_WINDOW_SIZE;
+    std::pmr::unordered_map<uint32_t, int64_t> stream_send_windows;
+
+    int64_t receive_window = H2_DEFAULT_WINDOW_SIZE;
+
+    uint64_t over_window = 0;
+    uint64_t resized = 0;
+    uint64_t window_overflows = 0;
+    uint64_t zero_increments = 0;
+
+    private:
+    h2proto::DataFrame resized_data;
+    h2proto::WindowUpdateFrame resized_update;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+/* Compile-time dispatch over h2proto::Frame's oneof.
+ * Tables are indexed by FrameOneofCase, so anything that needs to act on
+ * "whichever frame is set" (encoders, decoders, statistics, mutation hooks)
+ * goes through VisitFrame() instead of growing its own switch.
+ */
+
+/* HTTP/2 frame type for each oneof case */
+static constexpr uint8_t frame_type_ids[] = {
+    [h2proto::Frame::FRAME_ONEOF_NOT_SET]   = 0xff,
+    [h2proto::Frame::kDataFrame]            = 0,
+    [h2proto::Frame::kHeadersFrame]         = 1,
+    [h2proto::Frame::kPriorityFrame]        = 2,
+    [h2proto::Frame::kRstStreamFrame]       = 3,
+    [h2proto::Frame::kSettingsFrame]        = 4,
+    [h2proto::Frame::kPushPromiseFrame]     = 5,
+    [h2proto::Frame::kPingFrame]            = 6,
+    [h2proto::Frame::kGoawayFrame]          = 7,
+    [h2proto::Frame::kWindowUpdateFrame]    = 8,
+    [h2proto::Frame::kContinuationFrame]    = 9
+};
+
+/* Inverse of frame_type_ids, indexed by HTTP/2 frame type */
+static constexpr h2proto::Frame::FrameOneofCase frame_oneof_cases[] = {
+    h2proto::Frame::kDataFrame,
+    h2proto::Frame::kHeadersFrame,
+    h2proto::Frame::kPriorityFrame,
+    h2proto::Frame::kRstStreamFrame,
+    h2proto::Frame::kSettingsFrame,
+    h2proto::Frame::kPushPromiseFrame,
+    h2proto::Frame::kPingFrame,
+    h2proto::Frame::kGoawayFrame,
+    h2proto::Frame::kWindowUpdateFrame,
+    h2proto::Frame::kContinuationFrame
+};
+
+static constexpr int num_frame_types =
+        sizeof(frame_oneof_cases) / sizeof(frame_oneof_cases[0]);
+
+static constexpr const char *frame_type_names[] = {
+    "DATA", "HEADERS", "PRIORITY", "RST_STREAM", "SETTINGS",
+    "PUSH_PROMISE", "PING", "GOAWAY", "WINDOW_UPDATE", "CONTINUATION"
+};
+
+
+/* One thunk per oneof case. Each thunk is a direct call into the visitor,
+ * so the visitor body is inlined and the only indirection is the table load.
+ */
+template <typename Visitor>
+struct FrameVisitTable {
+    using Result = std::invoke_result_t<Visitor&, const h2proto::DataFrame&>;
+    using Thunk = Result (*)(const h2proto::Frame&, Visitor&);
+
+    template <auto Get>
+    static Result visit(const h2proto::Frame& frame, Visitor& visitor) {
+        return visitor((frame.*Get)());
+    }
+
+    static Result unset(const h2proto::Frame&, Visitor&) {
+        if constexpr (!std::is_void_v<Result>) return Result();
+    }
+
+    static constexpr Thunk table[] = {
+        [h2proto::Frame::FRAME_ONEOF_NOT_SET]   = unset,
+        [h2proto::Frame::kDataFrame]            = visit<&h2proto::Frame::data_frame>,
+        [h2proto::Frame::kHeadersFrame]         = visit<&h2proto::Frame::headers_frame>,
+        [h2proto::Frame::kPriorityFrame]        = visit<&h2proto::Frame::priority_frame>,
+        [h2proto::Frame::kRstStreamFrame]       = visit<&h2proto::Frame::rst_stream_frame>,
+        [h2proto::Frame::kSettingsFrame]        = visit<&h2proto::Frame::settings_frame>,
+        [h2proto::Frame::kPushPromiseFrame]     = visit<&h2proto::Frame::push_promise_frame>,
+        [h2proto::Frame::kPingFrame]            = visit<&h2proto::Frame::ping_frame>,
+        [h2proto::Frame::kGoawayFrame]          = visit<&h2proto::Frame::goaway_frame>,
+        [h2proto::Frame::kWindowUpdateFrame]    = visit<&h2proto::Frame::window_update_frame>,
+        [h2proto::Frame::kContinuationFrame]    = visit<&h2proto::Frame::continuation_frame>
+    };
+};
+
+/* Same as FrameVisitTable, handing the visitor a mutable reference */
+template <typename Visitor>
+struct MutableFrameVisitTable {
+    using Result = std::invoke_result_t<Visitor&, h2proto::DataFrame&>;
+    using Thunk = Result (*)(h2proto::Frame&, Visitor&);
+
+    template <auto Get>
+    static Result visit(h2proto::Frame& frame, Visitor& visitor) {
+        return visitor(*(frame.*Get)());
+    }
+
+    static Result unset(h2proto::Frame&, Visitor&) {
+        if constexpr (!std::is_void_v<Result>) return Result();
+    }
+
+    static constexpr Thunk table[] = {
+        [h2proto::Frame::FRAME_ONEOF_NOT_SET]   = unset,
+        [h2proto::Frame::kDataFrame]            = visit<&h2proto::Frame::mutable_data_frame>,
+        [h2proto::Frame::kHeadersFrame]         = visit<&h2proto::Frame::mutable_headers_frame>,
+        [h2proto::Frame::kPriorityFrame]        = visit<&h2proto::Frame::mutable_priority_frame>,
+        [h2proto::Frame::kRstStreamFrame]       = visit<&h2proto::Frame::mutable_rst_stream_frame>,
+        [h2proto::Frame::kSettingsFrame]        = visit<&h2proto::Frame::mutable_settings_frame>,
+        [h2proto::Frame::kPushPromiseFrame]     = visit<&h2proto::Frame::mutable_push_promise_frame>,
+        [h2proto::Frame::kPingFrame]            = visit<&h2proto::Frame::mutable_ping_frame>,
+        [h2proto::Frame::kGoawayFrame]          = visit<&h2proto::Frame::mutable_goaway_frame>,
+        [h2proto::Frame::kWindowUpdateFrame]    = visit<&h2proto::Frame::mutable_window_update_frame>,
+        [h2proto::Frame::kContinuationFrame]    = visit<&h2proto::Frame::mutable_continuation_frame>
+    };
+};
+
+/* Call visitor with whichever frame message is set. The visitor must accept
+ * every frame type (a generic lambda is the usual choice) and return the same
+ * type for all of them. Unset frames are skipped and yield Result().
+ */
+template <typename Visitor>
+decltype(auto) VisitFrame(const h2proto::Frame& frame, Visitor&& visitor)
+{
+    using Table = FrameVisitTable<std::remove_reference_t<Visitor>>;
+    return Table::table[frame.frame_oneof_case()](frame, visitor);
+}
+
+template <typename Visitor>
+decltype(auto) VisitFrame(h2proto::Frame *frame, Visitor&& visitor)
+{
+    using Table = MutableFrameVisitTable<std::remove_reference_t<Visitor>>;
+    return Table::table[frame->frame_oneof_case()](*frame, visitor);
+}
+
+/* Set frame to an empty message of the given case and visit it. Decoders
+ * pick the case from the wire type with frame_oneof_cases.
+ */
+template <typename Visitor>
+decltype(auto) VisitFrame(h2proto::Frame *frame,
+        h2proto::Frame::FrameOneofCase which, Visitor&& visitor)
+{
+    using Table = MutableFrameVisitTable<std::remove_reference_t<Visitor>>;
+    return Table::table[which](*frame, visitor);
+}
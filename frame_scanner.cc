@@ -0,0 +1,279 @@
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "frame_scanner.h"
+#include "protobuf_decoders.h"
+#include "protobuf_encoders.h"
+#include "frame_dispatch.h"
+#include "byte_order.h"
+
+/* What a well-formed header of each type looks like (RFC 7540 6) */
+struct FrameRule {
+    uint32_t min_length;
+    uint32_t max_length;
+    uint32_t multiple;      // Length must be a multiple of this
+    uint8_t flags;          // Defined flags
+    uint8_t streams;        // Bit 0: stream 0 allowed, bit 1: others allowed
+};
+
+#define ANY_LENGTH H2_MAX_MAX_FRAME_SIZE
+#define STREAM_ZERO 1
+#define STREAM_SET 2
+
+static constexpr FrameRule frame_rules[] = {
+    [0] = { 0, ANY_LENGTH, 1, 0x09, STREAM_SET },               // DATA
+    [1] = { 0, ANY_LENGTH, 1, 0x2d, STREAM_SET },               // HEADERS
+    [2] = { 5, 5, 1, 0x00, STREAM_SET },                        // PRIORITY
+    [3] = { 4, 4, 1, 0x00, STREAM_SET },                        // RST_STREAM
+    [4] = { 0, ANY_LENGTH, 6, 0x01, STREAM_ZERO },              // SETTINGS
+    [5] = { 4, ANY_LENGTH, 1, 0x0c, STREAM_SET },               // PUSH_PROMISE
+    [6] = { 8, 8, 1, 0x01, STREAM_ZERO },                       // PING
+    [7] = { 8, ANY_LENGTH, 1, 0x00, STREAM_ZERO },              // GOAWAY
+    [8] = { 4, 4, 1, 0x00, STREAM_ZERO | STREAM_SET },          // WINDOW_UPDATE
+    [9] = { 0, ANY_LENGTH, 1, 0x04, STREAM_SET },               // CONTINUATION
+    [10] = { 0, ANY_LENGTH, 1, 0xff, STREAM_ZERO | STREAM_SET } // Unknown
+};
+
+static_assert(sizeof(frame_rules) / sizeof(frame_rules[0]) == num_frame_types + 1);
+
+static inline uint8_t check_header(uint32_t length, uint8_t type, uint8_t flags,
+        uint32_t stream_field, uint32_t max_frame_size)
+{
+    bool unknown = type >= num_frame_types;
+    const FrameRule& rule = frame_rules[unknown ? num_frame_types : type];
+    bool has_stream = stream_field & MAX_INT_31;
+
+    bool bad_length = length - rule.min_length > rule.max_length - rule.min_length ||
+            length % rule.multiple;
+
+    return unknown * FRAME_UNKNOWN_TYPE |
+            bad_length * FRAME_BAD_LENGTH |
+            (length > max_frame_size) * FRAME_OVERSIZED |
+            ((flags & ~rule.flags) != 0) * FRAME_UNDEFINED_FLAGS |
+            !((rule.streams >> has_stream) & 1) * FRAME_BAD_STREAM |
+            (stream_field >> 31) * FRAME_RESERVED_BIT;
+}
+
+size_t FrameIndex::scan(std::string_view buf)
+{
+    const char *data = buf.data();
+    size_t size = buf.size();
+    size_t offset = 0;
+
+    if (expect_preface) {
+        std::string_view magic = H2_CLIENT_PREFACE;
+
+        if (size < magic.size() && magic.starts_with(buf))
+            return 0;
+
+        if (buf.starts_with(magic))
+            offset = magic.size();
+        expect_preface = false;
+    }
+
+    while (size - offset >= H2_FRAME_HEADER_SIZE) {
+        const char *header = data + offset;
+        uint32_t length = load_be24(header);
+
+        if (size - offset - H2_FRAME_HEADER_SIZE < length)
+            break;
+
+        // Start pulling in the next header while this one is recorded
+        size_t next = offset + H2_FRAME_HEADER_SIZE + length;
+        __builtin_prefetch(data + next);
+
+        uint8_t type = header[3];
+        uint8_t flags = header[4];
+        uint32_t stream_field = load_be32(header + 5);
+        uint8_t problems = check_header(length, type, flags, stream_field,
+                max_frame_size);
+
+        frames.push_back({ position + offset, length, type, flags, problems,
+                stream_field & MAX_INT_31 });
+        flagged += problems != 0;
+
+        offset = next;
+    }
+
+    position += offset;
+    return offset;
+}
+
+void DecodeIndexed(std::string_view buf, const FrameIndex& index,
+        const std::function<bool(const FrameIndexEntry&)>& select,
+        h2proto::Sequence *seq, FrameDecoder& decoder)
+{
+    // Frames decoded only for their HPACK side effects
+    h2proto::Sequence skipped;
+    bool block_selected = false;
+
+    for (const auto& entry : index.frames) {
+        bool header_block = entry.type == 1 || entry.type == 5 || entry.type == 9;
+        bool continues = entry.type == 9 && decoder.block_open;
+        bool selected = select(entry) || (continues && block_selected);
+
+        if (!continues)
+            block_selected = selected;
+
+        if (!selected && !header_block)
+            continue;
+
+        if (entry.offset + H2_FRAME_HEADER_SIZE + entry.length > buf.size())
+            break;
+
+        RawFrame raw = {
+            .length = entry.length,
+            .type = entry.type,
+            .flags = entry.flags,
+            .stream_id = entry.stream_id,
+            .payload = buf.substr(entry.offset + H2_FRAME_HEADER_SIZE, entry.length),
+            .offset = entry.offset
+        };
+
+        decoder.decode_frame(raw, selected ? seq : &skipped);
+
+        if (!decoder.block_open)
+            skipped.Clear();
+    }
+}
+
+static h2proto::HeaderField literal(const std::string& name, const std::string& value)
+{
+    h2proto::HeaderField field;
+    field.mutable_name()->set_data(name);
+    field.mutable_name()->set_force_literal(true);
+    field.mutable_name()->set_huffman(false);
+    field.mutable_value()->set_data(value);
+    field.mutable_value()->set_force_literal(true);
+    field.mutable_value()->set_huffman(false);
+    field.set_indexing(h2proto::HeaderField_Indexing_INCREMENTAL);
+    return field;
+}
+
+void FrameIndex::run_tests()
+{
+    // A selected HEADERS keeps the fields that end in its CONTINUATION
+    {
+        h2proto::Sequence sent;
+        h2proto::HeadersFrame *headers = sent.add_frames()->mutable_headers_frame();
+        headers->set_stream_id(1);
+        headers->set_end_stream(true);
+        headers->set_end_headers(false);
+        for (int i = 0; i < 5; i++)
+            *headers->add_header_list() = literal("x-field-" + std::to_string(i),
+                    std::string(3000, 'a' + i));
+
+        h2proto::ContinuationFrame *continuation =
+                sent.add_frames()->mutable_continuation_frame();
+        continuation->set_stream_id(1);
+        continuation->set_end_headers(true);
+        *continuation->add_header_list() = literal("x-field-5", std::string(3000, 'f'));
+
+        // A PING that is not selected, then a block that refers to the first
+        sent.add_frames()->mutable_ping_frame()->set_ack(false);
+        h2proto::HeadersFrame *next = sent.add_frames()->mutable_headers_frame();
+        next->set_stream_id(3);
+        next->set_end_stream(true);
+        next->set_end_headers(true);
+        *next->add_header_list() = literal("x-field-5", std::string(3000, 'f'));
+
+        std::string wire = Encode(sent);
+
+        FrameIndex index;
+        assert(index.scan(wire) == wire.size());
+        assert(index.frames.size() == 4);
+
+        h2proto::Sequence seq;
+        FrameDecoder decoder;
+        DecodeIndexed(wire, index,
+                [](const FrameIndexEntry& entry) { return entry.type == 1; },
+                &seq, decoder);
+
+        assert(decoder.errors.empty());
+        assert(seq.frames_size() == 3);
+        assert(seq.frames(0).headers_frame().header_list_size() == 5);
+        assert(!seq.frames(0).headers_frame().end_headers());
+        assert(seq.frames(1).continuation_frame().header_list_size() == 1);
+        assert(seq.frames(1).continuation_frame().end_headers());
+        assert(seq.frames(1).continuation_frame().header_list(0).value().data() ==
+                std::string(3000, 'f'));
+        assert(seq.frames(2).headers_frame().stream_id() == 3);
+        assert(seq.frames(2).headers_frame().header_list(0).value().data() ==
+                std::string(3000, 'f'));
+    }
+
+    // The block of a skipped HEADERS still updates the HPACK table, and its
+    // CONTINUATION is not selected along with it
+    {
+        h2proto::Sequence sent;
+        h2proto::HeadersFrame *headers = sent.add_frames()->mutable_headers_frame();
+        headers->set_stream_id(1);
+        headers->set_end_stream(true);
+        headers->set_end_headers(false);
+
+        h2proto::ContinuationFrame *continuation =
+                sent.add_frames()->mutable_continuation_frame();
+        continuation->set_stream_id(1);
+        continuation->set_end_headers(true);
+        *continuation->add_header_list() = literal("x-field", "value");
+
+        h2proto::HeadersFrame *next = sent.add_frames()->mutable_headers_frame();
+        next->set_stream_id(3);
+        next->set_end_stream(true);
+        next->set_end_headers(true);
+        *next->add_header_list() = literal("x-field", "value");
+
+        std::string wire = Encode(sent);
+
+        FrameIndex index;
+        index.scan(wire);
+
+        h2proto::Sequence seq;
+        FrameDecoder decoder;
+        DecodeIndexed(wire, index,
+                [](const FrameIndexEntry& entry) { return entry.stream_id == 3; },
+                &seq, decoder);
+
+        assert(decoder.errors.empty());
+        assert(seq.frames_size() == 1);
+        assert(seq.frames(0).headers_frame().header_list(0).value().data() == "value");
+        assert(decoder.hpack.dynamic_table.size() == 2);
+    }
+}
+
+MappedFile::MappedFile(const char *path, bool sequential)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        size_t size = st.st_size;
+        void *p = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+
+        if (p != MAP_FAILED) {
+            if (p)
+                madvise(p, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+            data = std::string_view((const char *)p, size);
+            ok = true;
+        }
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (!data.empty())
+        munmap((void *)data.data(), data.size());
+}
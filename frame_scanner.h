@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "encoding_context.h"
+
+struct FrameDecoder;
+
+/* Header problems found while scanning, as a bitmask. None of them stop the
+ * scan; they mark frames a decoder would reject or treat specially.
+ */
+enum FrameHeaderProblem : uint8_t {
+    FRAME_UNKNOWN_TYPE  = 1 << 0,   // No grammar message for the type
+    FRAME_BAD_LENGTH    = 1 << 1,   // Length impossible for the type
+    FRAME_OVERSIZED     = 1 << 2,   // Over FrameIndex::max_frame_size
+    FRAME_UNDEFINED_FLAGS = 1 << 3, // Flags the type does not define
+    FRAME_BAD_STREAM    = 1 << 4,   // Stream 0 where one is required, or vice versa
+    FRAME_RESERVED_BIT  = 1 << 5    // Reserved bit of the stream ID set
+};
+
+struct FrameIndexEntry {
+    uint64_t offset;        // Of the frame header
+    uint32_t length;
+    uint8_t type;
+    uint8_t flags;
+    uint8_t problems;       // FrameHeaderProblem bits
+    uint32_t stream_id;     // Reserved bit cleared
+};
+
+/* Frame boundaries of a raw HTTP/2 stream, without decoding payloads.
+ * The walk is inherently serial (each header's position depends on the
+ * previous length), so it is kept short: the next header is prefetched as
+ * soon as the current length is known, and validation is a table lookup
+ * with no branches per check. A leading client preface is skipped.
+ *
+ * Like FrameDecoder::decode(), scan() takes the stream in pieces and returns
+ * the bytes covered by complete frames. Offsets are from the start of the
+ * stream.
+ */
+struct FrameIndex {
+    size_t scan(std::string_view buf);
+
+    std::vector<FrameIndexEntry> frames;
+
+    /* Number of frames with any problem bit set */
+    size_t flagged = 0;
+
+    uint32_t max_frame_size = H2_MAX_MAX_FRAME_SIZE;
+
+    /* Offset of the next scan() input from the start of the stream */
+    uint64_t position = 0;
+    bool expect_preface = true;
+
+    static void run_tests();
+};
+
+/* Decode the frames of an indexed stream that select accepts. buf must hold
+ * the stream from offset 0. The CONTINUATIONs of a selected HEADERS or
+ * PUSH_PROMISE are decoded with it, so its header block comes back whole.
+ * Header blocks of skipped frames still go through the HPACK decoder, since
+ * later blocks depend on its dynamic table; all other skipped payloads are
+ * never touched.
+ */
+void DecodeIndexed(std::string_view buf, const FrameIndex& index,
+        const std::function<bool(const FrameIndexEntry&)>& select,
+        h2proto::Sequence *seq, FrameDecoder& decoder);
+
+/* Read-only mapping of a file, read ahead sequentially unless the caller
+ * jumps around in it (corpus packs)
+ */
+struct MappedFile {
+    MappedFile(const char *path, bool sequential = true);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view data;
+    bool ok = false;
+};
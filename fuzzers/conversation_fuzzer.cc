@@ -0,0 +1,111 @@
+/* End-to-end fuzz target without an external server.
+ *
+ * Each Conversation is encoded exchange by exchange into a memory pipe
+ * read by ServerStub, which decodes it (frames and HPACK) and replies like
+ * a server would. The exec/s libFuzzer reports is the cost of the grammar,
+ * encoders and decoders alone, to compare against a real target.
+ * With H2_ROUNDTRIP_CHECK set, every input is also checked with
+ * CheckRoundTrip and a mismatch aborts. Mutated conversations are
+ * repaired by the post-processors in post_processors.h, with stream IDs
+ * renumbered across exchanges, and crossed over at exchange and frame
+ * boundaries with CrossOver() (proto_fuzzer.h).
+ * H2_STREAM_MODE=observe|repair|violate sets the stream state policy of
+ * the encoder (see stream_states.h); violate puts the one illegal
+ * transition at a frame picked from the input's size.
+ * H2_FLOW_MODE=observe|clamp|boundary|exceed|overflow sets the flow-control
+ * policy (see flow_control.h); overflow keeps DATA as given and pushes the
+ * receive window past 2^31-1 with one WINDOW_UPDATE.
+ * With -DH2_FUZZ_FEATURES, encoder states (HPACK table fill, frame type
+ * pairs, stream and window transitions, priority tree shape) count as
+ * coverage too (see encoder_features.h).
+ *
+ * Build with libprotobuf-mutator, e.g.
+ *   clang++ -std=c++20 -O1 -g -fsanitize=fuzzer,address -I. -Igenfiles \
+ *       -I$LPM -I$LPM/build/external.protobuf/include \
+ *       -DH2_FUZZ_FEATURES fuzzers/conversation_fuzzer.cc *.cc genfiles/h2_*.pb.cc \
+ *       -lprotobuf-mutator-libfuzzer -lprotobuf-mutator -lprotobuf
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "src/libfuzzer/libfuzzer_macro.h"
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "encoding_context.h"
+#include "encode_arena.h"
+#include "server_stub.h"
+#include "roundtrip_check.h"
+#include "fuzzers/post_processors.h"
+#include "fuzzers/proto_fuzzer.h"
+
+static PostProcessor<h2proto::Conversation> repair_conversation = {
+    [](h2proto::Conversation *conversation, unsigned int seed) {
+        STAGE_TIMER(FUZZ_STAGE_POST_PROCESS);
+        if (repair_selected(seed))
+            RepairConversation(conversation);
+    }
+};
+
+static StreamPolicy::Mode stream_mode()
+{
+    const char *mode = getenv("H2_STREAM_MODE");
+
+    if (!mode)
+        return StreamPolicy::UNTRACKED;
+    if (!strcmp(mode, "observe"))
+        return StreamPolicy::OBSERVE;
+    if (!strcmp(mode, "repair"))
+        return StreamPolicy::REPAIR;
+    if (!strcmp(mode, "violate"))
+        return StreamPolicy::VIOLATE_ONCE;
+    return StreamPolicy::UNTRACKED;
+}
+
+static FlowPolicy flow_policy()
+{
+    const char *mode = getenv("H2_FLOW_MODE");
+    FlowPolicy policy;
+
+    if (!mode)
+        return policy;
+    if (!strcmp(mode, "observe"))
+        policy.data = FlowPolicy::OBSERVE;
+    else if (!strcmp(mode, "clamp"))
+        policy.data = FlowPolicy::CLAMP;
+    else if (!strcmp(mode, "boundary"))
+        policy.data = FlowPolicy::BOUNDARY;
+    else if (!strcmp(mode, "exceed"))
+        policy.data = FlowPolicy::EXCEED;
+    else if (!strcmp(mode, "overflow"))
+        policy.overflow_window = true;
+    return policy;
+}
+
+DEFINE_H2_PROTO_FUZZER(h2proto::Conversation, conversation)
+{
+    static bool check_roundtrip = getenv("H2_ROUNDTRIP_CHECK");
+    static StreamPolicy::Mode mode = stream_mode();
+    static FlowPolicy flow = flow_policy();
+    static EncodeArena arena;
+
+    {
+        EncodingContext ctx(arena.resource());
+        ctx.streams.policy.mode = mode;
+        ctx.flow.policy = flow;
+        FEATURE(ctx.priorities.tracked = true);
+        if (mode == StreamPolicy::VIOLATE_ONCE)
+            ctx.streams.policy.violate_at = conversation.ByteSizeLong() % 16;
+
+        RunAgainstServerStub(conversation, ctx);
+    }
+    arena.reset();
+
+    std::string report;
+    if (check_roundtrip && !CheckRoundTrip(conversation, &report)) {
+        fprintf(stderr, "Encoder round trip failed:\n%s", report.c_str());
+        abort();
+    }
+}
@@ -0,0 +1,224 @@
+/* Build, inspect and replay single-file corpus packs (see corpus_pack.h).
+ *
+ *   corpus_pack_tool pack PACK PATH...     append seed files or directories
+ *   corpus_pack_tool unpack PACK DIR [--text]
+ *                                          one seed file per record
+ *   corpus_pack_tool compact PACK          drop stale, duplicate, bad records
+ *   corpus_pack_tool list PACK             record sizes and exchange counts
+ *   corpus_pack_tool replay PACK           run every record against
+ *                                          ServerStub and CheckRoundTrip
+ *
+ * Seeds may be binary or text Conversations; packs always hold binary.
+ * libFuzzer itself only reads corpus directories, so fuzz workers are
+ * seeded with unpack (into a tmpfs, say) while everything else reads the
+ * pack directly. unpack writes binary seeds, which the default fuzzer build
+ * reads; --text writes text protos for builds with -DH2_BINARY_CORPUS=0.
+ *
+ * Build: c++ -std=c++20 -O2 -I. -Igenfiles fuzzers/corpus_pack_tool.cc \
+ *            *.cc genfiles/h2_*.pb.cc -lprotobuf -o corpus_pack_tool
+ */
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/io/tokenizer.h>
+#include <google/protobuf/text_format.h>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "corpus_pack.h"
+#include "encoding_context.h"
+#include "server_stub.h"
+#include "roundtrip_check.h"
+
+namespace fs = std::filesystem;
+
+struct SilentErrors : google::protobuf::io::ErrorCollector {
+    void AddError(int, int, const std::string&) override {}
+};
+
+/* Text is tried first: text protos can happen to parse as binary ones */
+static bool read_seed(const fs::path& path, std::string *serialized)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream bytes;
+    bytes << in.rdbuf();
+
+    h2proto::Conversation conversation;
+    std::string data = bytes.str();
+
+    SilentErrors errors;
+    google::protobuf::TextFormat::Parser parser;
+    parser.RecordErrorsTo(&errors);
+
+    if (!parser.ParseFromString(data, &conversation) &&
+            !conversation.ParseFromString(data))
+        return false;
+
+    return conversation.SerializeToString(serialized);
+}
+
+static int pack(const char *path, char **inputs, int count)
+{
+    std::vector<fs::path> files;
+    for (int i = 0; i < count; i++) {
+        if (fs::is_directory(inputs[i])) {
+            for (const auto& entry : fs::directory_iterator(inputs[i]))
+                if (entry.is_regular_file())
+                    files.push_back(entry.path());
+        } else {
+            files.push_back(inputs[i]);
+        }
+    }
+
+    std::vector<std::string> seeds;
+    std::vector<std::string_view> records;
+    seeds.reserve(files.size());
+
+    for (const fs::path& file : files) {
+        std::string serialized;
+        if (!read_seed(file, &serialized)) {
+            fprintf(stderr, "%s: not a Conversation\n", file.c_str());
+            continue;
+        }
+        seeds.push_back(std::move(serialized));
+    }
+    records.assign(seeds.begin(), seeds.end());
+
+    if (!AppendToCorpusPack(path, records)) {
+        fprintf(stderr, "%s: append failed\n", path);
+        return 1;
+    }
+
+    printf("%zu records added\n", records.size());
+    return 0;
+}
+
+static int unpack(const CorpusPack& pack, const char *dir, bool text)
+{
+    h2proto::Conversation conversation;
+    size_t damaged = 0;
+
+    fs::create_directories(dir);
+
+    for (size_t i = 0; i < pack.size(); i++) {
+        std::string name = "seed_" + std::to_string(i);
+        std::string_view record = pack.record(i);
+        std::string printed;
+
+        // Text needs the record parsed; binary is copied as it is
+        if (text) {
+            if (!pack.load(i, &conversation) ||
+                    !google::protobuf::TextFormat::PrintToString(conversation, &printed)) {
+                damaged++;
+                continue;
+            }
+            record = printed;
+        }
+
+        std::ofstream out(fs::path(dir) / (name + (text ? ".txt" : ".bin")),
+                std::ios::binary);
+        out.write(record.data(), record.size());
+    }
+
+    printf("%zu records unpacked, %zu damaged\n", pack.size() - damaged, damaged);
+    return 0;
+}
+
+static int list(const CorpusPack& pack)
+{
+    h2proto::Conversation conversation;
+
+    for (size_t i = 0; i < pack.size(); i++) {
+        if (!pack.load(i, &conversation))
+            printf("%6zu  damaged\n", i);
+        else
+            printf("%6zu  %8zu bytes  %4d exchanges\n", i, pack.record(i).size(),
+                    conversation.exchanges_size());
+    }
+    return 0;
+}
+
+static int replay(const CorpusPack& pack)
+{
+    h2proto::Conversation conversation;
+    ServerStubRun total;
+    size_t damaged = 0, mismatches = 0, goaways = 0, peer_goaways = 0;
+
+    for (size_t i = 0; i < pack.size(); i++) {
+        if (!pack.load(i, &conversation)) {
+            damaged++;
+            continue;
+        }
+
+        EncodingContext ctx;
+        ServerStubRun run = RunAgainstServerStub(conversation, ctx);
+        total.bytes_sent += run.bytes_sent;
+        total.frames += run.frames;
+        total.requests += run.requests;
+        total.exchanges_matched += run.exchanges_matched;
+        goaways += run.goaway;
+        peer_goaways += run.peer_goaway;
+
+        std::string report;
+        if (!CheckRoundTrip(conversation, &report)) {
+            printf("record %zu: round trip failed\n%s", i, report.c_str());
+            mismatches++;
+        }
+    }
+
+    printf("%zu records, %zu damaged, %zu round trip mismatches\n",
+            pack.size(), damaged, mismatches);
+    printf("%lu bytes sent, %lu frames, %lu requests answered, "
+            "%lu exchanges matched, %zu GOAWAYs sent, %zu received\n",
+            total.bytes_sent, total.frames, total.requests,
+            total.exchanges_matched, goaways, peer_goaways);
+    return mismatches ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s pack|unpack|compact|list|replay PACK [ARGS]\n",
+                argv[0]);
+        return 2;
+    }
+
+    const char *command = argv[1];
+    const char *path = argv[2];
+
+    if (!strcmp(command, "pack"))
+        return pack(path, argv + 3, argc - 3);
+
+    if (!strcmp(command, "compact")) {
+        long kept = CompactCorpusPack(path);
+        if (kept < 0) {
+            fprintf(stderr, "%s: compaction failed\n", path);
+            return 1;
+        }
+        printf("%ld records kept\n", kept);
+        return 0;
+    }
+
+    CorpusPack pack(path);
+    if (!pack.ok) {
+        fprintf(stderr, "%s: not a corpus pack\n", path);
+        return 1;
+    }
+
+    if (!strcmp(command, "unpack") && argc == 4)
+        return unpack(pack, argv[3], false);
+    if (!strcmp(command, "unpack") && argc == 5 && !strcmp(argv[4], "--text"))
+        return unpack(pack, argv[3], true);
+    if (!strcmp(command, "list"))
+        return list(pack);
+    if (!strcmp(command, "replay"))
+        return replay(pack);
+
+    fprintf(stderr, "%s: unknown command or missing arguments\n", command);
+    return 2;
+}
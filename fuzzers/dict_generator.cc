@@ -0,0 +1,304 @@
+/* Expand a libFuzzer dictionary into the byte forms a server actually sees.
+ *
+ *   dict_generator [--corpus=PACK]... [--min-count=N] [--max-mined=N] \
+ *       h2fuzzer.dict > generated.dict
+ *
+ * Every token of the input dictionary, every name and value of the HPACK
+ * static table, and header names and values mined from corpus packs (seen
+ * at least --min-count times, 2 by default, most common --max-mined, 256 by
+ * default) are written out as:
+ *
+ *  - the token itself
+ *  - HPACK strings, plain and Huffman coded (Encode<HPackString>)
+ *  - header field representations using a static table index
+ *    (Encode<HPackInt>): fully indexed for name/value pairs in the table,
+ *    literal with indexed name for names, and the literal new-name prefix
+ *
+ * followed by frame header patterns (type, common flags and stream IDs) and
+ * complete SETTINGS frames and the client preface.
+ *
+ * Build: c++ -std=c++20 -O2 -I. -Igenfiles fuzzers/dict_generator.cc \
+ *            *.cc genfiles/h2_*.pb.cc -lprotobuf -o dict_generator
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "protobuf_encoders.h"
+#include "hpack_compressor.h"
+#include "connection_preface.h"
+#include "corpus_pack.h"
+#include "frame_dispatch.h"
+
+/* libFuzzer refuses the whole file if any entry is longer */
+static constexpr size_t MAX_DICT_ENTRY = 64;
+
+/* Dictionary entries grouped by kind, each written once */
+struct Dictionary {
+    void add(const std::string& entry, const char *kind);
+    void write(FILE *out) const;
+
+    std::set<std::string> seen;
+    std::vector<std::pair<const char *, std::vector<std::string>>> sections;
+};
+
+void Dictionary::add(const std::string& entry, const char *kind)
+{
+    if (entry.empty() || entry.size() > MAX_DICT_ENTRY ||
+            !seen.insert(entry).second)
+        return;
+
+    auto section = std::find_if(sections.begin(), sections.end(),
+            [&](const auto& s) { return !strcmp(s.first, kind); });
+    if (section == sections.end())
+        section = sections.insert(section, { kind, {} });
+
+    section->second.push_back(entry);
+}
+
+void Dictionary::write(FILE *out) const
+{
+    for (const auto& [kind, entries] : sections) {
+        fprintf(out, "# %s\n", kind);
+
+        for (const std::string& entry : entries) {
+            fputc('"', out);
+            for (uint8_t c : entry) {
+                if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\')
+                    fputc(c, out);
+                else
+                    fprintf(out, "\\x%02X", c);
+            }
+            fputs("\"\n", out);
+        }
+        fputc('\n', out);
+    }
+}
+
+/* Quoted entries of a libFuzzer dictionary, with \\, \" and \xNN escapes */
+static bool read_dictionary(const char *path, std::vector<std::string>& tokens)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t open = line.find('"');
+        size_t close = line.rfind('"');
+        if (line.empty() || line[0] == '#' || open == close)
+            continue;
+
+        std::string token;
+        for (size_t i = open + 1; i < close; i++) {
+            if (line[i] != '\\' || i + 1 == close) {
+                token += line[i];
+            } else if (line[i + 1] == 'x' && i + 3 < close) {
+                token += (char)strtol(line.substr(i + 2, 2).c_str(), nullptr, 16);
+                i += 3;
+            } else {
+                token += line[++i];
+            }
+        }
+        tokens.push_back(token);
+    }
+    return true;
+}
+
+/* Header names and values from every header block of every record */
+static void mine_pack(const char *path, std::map<std::string, int>& counts)
+{
+    CorpusPack pack(path);
+    if (!pack.ok) {
+        fprintf(stderr, "%s: not a corpus pack\n", path);
+        return;
+    }
+
+    h2proto::Conversation conversation;
+    auto mine = [&](const h2proto::Sequence& seq) {
+        for (const h2proto::Frame& frame : seq.frames()) {
+            VisitFrame(frame, [&](const auto& f) {
+                if constexpr (requires { f.header_list(); }) {
+                    for (const h2proto::HeaderField& field : f.header_list()) {
+                        counts[field.name().data()]++;
+                        counts[field.value().data()]++;
+                    }
+                }
+            });
+        }
+    };
+
+    for (size_t i = 0; i < pack.size(); i++) {
+        if (!pack.load(i, &conversation))
+            continue;
+
+        for (const h2proto::Exchange& exchange : conversation.exchanges()) {
+            mine(exchange.request_sequence());
+            mine(exchange.response_sequence());
+        }
+    }
+}
+
+static std::string hpack_string(const std::string& token, bool huffman)
+{
+    h2proto::HPackString str;
+    str.set_data(token);
+    str.set_force_literal(true);
+    str.set_huffman(huffman);
+    return Encode(str);
+}
+
+static std::string hpack_int(uint64_t value, uint32_t prefix, uint32_t msb_mask)
+{
+    h2proto::HPackInt integer;
+    integer.set_value(value);
+    integer.set_prefix(prefix);
+    integer.set_msb_mask(msb_mask);
+    return Encode(integer);
+}
+
+/* Representations that refer to the static table (RFC 7541 6.1, 6.2) */
+static void add_indexed_forms(Dictionary& dict, const std::string& token)
+{
+    const auto& table = HPackCompressor::static_table;
+
+    for (size_t i = 0; i < table.size(); i++) {
+        const auto& [name, value] = table[i];
+        uint64_t index = i + 1;
+
+        if (name == token) {
+            dict.add(hpack_int(index, 6, 0x40), "literal with indexed name");
+            dict.add(hpack_int(index, 4, 0x00), "literal with indexed name");
+            dict.add(hpack_int(index, 4, 0x10), "literal with indexed name");
+        }
+        if (value == token || (name == token && value.empty()))
+            dict.add(hpack_int(index, 7, 0x80), "indexed field");
+    }
+}
+
+static void add_token(Dictionary& dict, const std::string& token,
+        const char *kind)
+{
+    dict.add(token, kind);
+    dict.add(hpack_string(token, false), "HPACK string");
+    dict.add(hpack_string(token, true), "HPACK string, Huffman");
+    add_indexed_forms(dict, token);
+
+    // Incremental indexing with a literal name, name part only
+    dict.add("\x40" + hpack_string(token, false), "literal with new name");
+    dict.add("\x40" + hpack_string(token, true), "literal with new name");
+}
+
+/* Type, flags and stream ID of a frame header; the length varies too much
+ * to be worth fixing
+ */
+struct FramePattern {
+    uint8_t type;
+    std::vector<uint8_t> flags;
+    std::vector<uint32_t> stream_ids;
+};
+
+static const FramePattern frame_patterns[] = {
+    { 0x0, { 0x0, 0x1, 0x8, 0x9 },          { 1, 3 } },
+    { 0x1, { 0x4, 0x5, 0x24, 0x25, 0x0 },   { 1, 3 } },
+    { 0x2, { 0x0 },                         { 1, 3 } },
+    { 0x3, { 0x0 },                         { 1, 3 } },
+    { 0x4, { 0x0, 0x1 },                    { 0 } },
+    { 0x5, { 0x4, 0x0 },                    { 1 } },
+    { 0x6, { 0x0, 0x1 },                    { 0 } },
+    { 0x7, { 0x0 },                         { 0 } },
+    { 0x8, { 0x0 },                         { 0, 1 } },
+    { 0x9, { 0x4, 0x0 },                    { 1, 3 } }
+};
+
+static void add_frame_patterns(Dictionary& dict)
+{
+    for (const FramePattern& pattern : frame_patterns) {
+        for (uint8_t flags : pattern.flags) {
+            for (uint32_t stream_id : pattern.stream_ids) {
+                std::string header = enframe(pattern.type, flags, stream_id, "");
+                dict.add(header.substr(3), "frame headers");
+            }
+        }
+    }
+
+    h2proto::SettingsFrame settings;
+    settings.set_ack(true);
+    dict.add(Encode(settings), "frames");
+
+    settings.set_ack(false);
+    dict.add(Encode(settings), "frames");
+
+    settings.set_header_table_size(0);
+    settings.set_initial_window_size(65535);
+    settings.set_max_frame_size(16384);
+    dict.add(Encode(settings), "frames");
+
+    dict.add(H2_CLIENT_PREFACE, "frames");
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<const char *> packs;
+    const char *input = nullptr;
+    int min_count = 2;
+    size_t max_mined = 256;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--corpus=", 9)) packs.push_back(argv[i] + 9);
+        else if (!strncmp(argv[i], "--min-count=", 12)) min_count = atoi(argv[i] + 12);
+        else if (!strncmp(argv[i], "--max-mined=", 12)) max_mined = atol(argv[i] + 12);
+        else input = argv[i];
+    }
+
+    if (!input) {
+        fprintf(stderr, "usage: %s [--corpus=PACK]... [--min-count=N] "
+                "[--max-mined=N] input.dict\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<std::string> tokens;
+    if (!read_dictionary(input, tokens)) {
+        fprintf(stderr, "%s: cannot read\n", input);
+        return 2;
+    }
+
+    Dictionary dict;
+    for (const std::string& token : tokens)
+        add_token(dict, token, "dictionary tokens");
+
+    for (const auto& [name, value] : HPackCompressor::static_table) {
+        add_token(dict, name, "static table");
+        add_token(dict, value, "static table");
+    }
+
+    std::map<std::string, int> counts;
+    for (const char *pack : packs)
+        mine_pack(pack, counts);
+
+    std::vector<std::pair<int, std::string>> mined;
+    for (const auto& [token, count] : counts) {
+        if (count >= min_count && token.size() >= 2 && token.size() <= 64 &&
+                !dict.seen.count(token))
+            mined.emplace_back(count, token);
+    }
+
+    std::stable_sort(mined.begin(), mined.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+    mined.resize(std::min(mined.size(), max_mined));
+
+    for (const auto& [count, token] : mined)
+        add_token(dict, token, "mined from corpus");
+
+    add_frame_patterns(dict);
+    dict.write(stdout);
+    return 0;
+}
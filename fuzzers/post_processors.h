@@ -0,0 +1,55 @@
+#pragma once
+
+/* libprotobuf-mutator post-processors shared by the fuzzers.
+ *
+ * After each mutation LPM calls these on every message of the registered
+ * types, and they apply the repairs from sequence_repair.h. Only a share of
+ * calls repairs anything: H2_REPAIR_PROBABILITY (0 to 1, default 0.8) sets
+ * it, so the targets still see broken stream IDs and header blocks
+ * now and then. With 0, the post-processors do nothing.
+ *
+ * Include from exactly one translation unit of a fuzzer. The registration of
+ * the top-level type (Sequence or Conversation) is left to the fuzzer, since
+ * stream IDs of a conversation have to be repaired across its exchanges and
+ * not per Sequence.
+ */
+#include <cstdlib>
+#include <algorithm>
+#include <cstdint>
+
+#include "src/libfuzzer/libfuzzer_macro.h"
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "sequence_repair.h"
+#include "stage_timers.h"
+
+template <typename Message>
+using PostProcessor = protobuf_mutator::libfuzzer::PostProcessorRegistration<Message>;
+
+static bool repair_selected(unsigned int seed)
+{
+    static const uint32_t threshold = [] {
+        const char *env = getenv("H2_REPAIR_PROBABILITY");
+        double probability = env ? std::clamp(atof(env), 0.0, 1.0) : 0.8;
+        return uint32_t(probability * 10000);
+    }();
+
+    return seed % 10000 < threshold;
+}
+
+static PostProcessor<h2proto::HeadersFrame> repair_headers_frame = {
+    [](h2proto::HeadersFrame *headers, unsigned int seed) {
+        STAGE_TIMER(FUZZ_STAGE_POST_PROCESS);
+        if (repair_selected(seed))
+            RepairPseudoHeaderOrder(headers->mutable_header_list());
+    }
+};
+
+static PostProcessor<h2proto::PushPromiseFrame> repair_push_promise_frame = {
+    [](h2proto::PushPromiseFrame *promise, unsigned int seed) {
+        STAGE_TIMER(FUZZ_STAGE_POST_PROCESS);
+        if (repair_selected(seed))
+            RepairPseudoHeaderOrder(promise->mutable_header_list());
+    }
+};
@@ -0,0 +1,96 @@
+/* Write priority tree stress conversations to a corpus pack.
+ *
+ *   priority_stress [--chain=N] [--fan=N] [--rounds=N] [--storm=N] \
+ *       [--streams=N] [--seed=N] PACK
+ *
+ * Appends one Conversation per shape (see priority_tree.h):
+ *
+ *  - a dependency chain --chain streams deep (1000 by default)
+ *  - a fan of --fan streams (1000) re-parented --rounds times (100) by
+ *    exclusive dependencies
+ *  - a storm of --storm reprioritizations (10000) among --streams
+ *    streams (100), seeded with --seed
+ *
+ * A shape is left out when its size is 0. Each one is encoded once with
+ * the priority tree tracked, and its shape is printed. The pack can seed
+ * the fuzzers or be replayed against a server to measure the CPU its
+ * priority scheduling costs.
+ *
+ * Build: c++ -std=c++20 -O2 -I. -Igenfiles fuzzers/priority_stress.cc \
+ *            *.cc genfiles/h2_*.pb.cc -lprotobuf -o priority_stress
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "protobuf_encoders.h"
+#include "encoding_context.h"
+#include "corpus_pack.h"
+
+static void report(const char *shape, const h2proto::Conversation& conversation)
+{
+    EncodingContext ctx;
+    ctx.priorities.tracked = true;
+    std::string wire = Encode(conversation, ctx);
+
+    const PriorityTree& tree = ctx.priorities;
+    printf("%-8s %8zu bytes  %6lu prioritizations  depth %6u  fan-out %6u  "
+            "%6lu cycles  %8lu exclusive moves\n", shape, wire.size(),
+            tree.prioritizations, tree.max_depth, tree.max_fan_out,
+            tree.cycles, tree.exclusive_moves);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t chain = 1000, fan = 1000, rounds = 100, storm = 10000, streams = 100;
+    unsigned seed = 1;
+    const char *path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--chain=", 8)) chain = atol(argv[i] + 8);
+        else if (!strncmp(argv[i], "--fan=", 6)) fan = atol(argv[i] + 6);
+        else if (!strncmp(argv[i], "--rounds=", 9)) rounds = atol(argv[i] + 9);
+        else if (!strncmp(argv[i], "--storm=", 8)) storm = atol(argv[i] + 8);
+        else if (!strncmp(argv[i], "--streams=", 10)) streams = atol(argv[i] + 10);
+        else if (!strncmp(argv[i], "--seed=", 7)) seed = atol(argv[i] + 7);
+        else path = argv[i];
+    }
+
+    if (!path) {
+        fprintf(stderr, "usage: %s [--chain=N] [--fan=N] [--rounds=N] [--storm=N] "
+                "[--streams=N] [--seed=N] PACK\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<std::string> seeds;
+    auto add = [&](const char *shape, auto&& append) {
+        h2proto::Conversation conversation;
+        append(conversation.add_exchanges()->mutable_request_sequence());
+        conversation.mutable_exchanges(0)->mutable_response_sequence();
+
+        report(shape, conversation);
+        seeds.push_back(conversation.SerializeAsString());
+    };
+
+    if (chain)
+        add("chain", [&](h2proto::Sequence *seq) { AppendPriorityChain(seq, 1, chain); });
+    if (fan)
+        add("fan", [&](h2proto::Sequence *seq) { AppendExclusiveFan(seq, 1, fan, rounds); });
+    if (storm)
+        add("storm", [&](h2proto::Sequence *seq) {
+            AppendReprioritizationStorm(seq, 1, streams, storm, seed);
+        });
+
+    std::vector<std::string_view> records(seeds.begin(), seeds.end());
+    if (!AppendToCorpusPack(path, records)) {
+        fprintf(stderr, "%s: append failed\n", path);
+        return 1;
+    }
+
+    printf("%zu records added\n", records.size());
+    return 0;
+}
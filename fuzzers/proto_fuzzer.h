@@ -0,0 +1,106 @@
+#pragma once
+
+/* DEFINE_PROTO_FUZZER with the structure-aware crossover from crossover.h.
+ *
+ * LPM's own crossover treats repeated fields as opaque lists, so it cuts
+ * header blocks apart and mixes stream IDs of unrelated connections. This
+ * defines the same libFuzzer entry points as DEFINE_PROTO_FUZZER, except
+ * that LLVMFuzzerCustomCrossOver goes through CrossOver().
+ *
+ *   DEFINE_H2_PROTO_FUZZER(h2proto::Conversation, conversation) { ... }
+ *
+ * The message type is given separately, since the parameter type cannot be
+ * recovered from the declaration in C++20.
+ *
+ * With -DH2_STAGE_TIMERS, mutation, crossover and each input are timed as
+ * stages of the fuzz loop (see stage_timers.h).
+ *
+ * Inputs are serialized protos by default, as wireshark/cap.py writes them
+ * and corpus packs hold them; they load far faster than text. Build with
+ * -DH2_BINARY_CORPUS=0 for text protos (cap.py --text, corpus_pack_tool
+ * unpack --text); corpora convert with wireshark/convert_corpus.py.
+ */
+#include <cstring>
+#include <string>
+
+#include <google/protobuf/text_format.h>
+
+#include "src/libfuzzer/libfuzzer_macro.h"
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "crossover.h"
+#include "stage_timers.h"
+
+#ifndef H2_BINARY_CORPUS
+#define H2_BINARY_CORPUS 1
+#endif
+
+template <typename Proto>
+size_t StructuredCrossOver(bool binary, const uint8_t *data1, size_t size1,
+        const uint8_t *data2, size_t size2, uint8_t *out, size_t max_out_size,
+        unsigned int seed)
+{
+    using protobuf_mutator::libfuzzer::LoadProtoInput;
+    STAGE_TIMER(FUZZ_STAGE_CROSSOVER);
+    Proto a, b, child;
+
+    if (!LoadProtoInput(binary, data1, size1, &a) ||
+            !LoadProtoInput(binary, data2, size2, &b))
+        return 0;
+
+    CrossOver(a, b, seed, &child);
+
+    std::string bytes;
+    if (binary)
+        child.SerializeToString(&bytes);
+    else
+        google::protobuf::TextFormat::PrintToString(child, &bytes);
+
+    // libFuzzer takes 0 as "no crossover this time"
+    if (bytes.size() > max_out_size)
+        return 0;
+
+    memcpy(out, bytes.data(), bytes.size());
+    return bytes.size();
+}
+
+#define DEFINE_STRUCTURED_CROSSOVER_IMPL(use_binary, Proto)                   \
+    extern "C" size_t LLVMFuzzerCustomCrossOver(                              \
+            const uint8_t *data1, size_t size1,                               \
+            const uint8_t *data2, size_t size2,                               \
+            uint8_t *out, size_t max_out_size, unsigned int seed) {           \
+        return StructuredCrossOver<Proto>(use_binary, data1, size1,           \
+                data2, size2, out, max_out_size, seed);                       \
+    }
+
+/* LPM's DEFINE_CUSTOM_PROTO_MUTATOR_IMPL and DEFINE_TEST_ONE_PROTO_INPUT_IMPL
+ * with stage timers
+ */
+#define DEFINE_TIMED_PROTO_MUTATOR_IMPL(use_binary, Proto)                    \
+    extern "C" size_t LLVMFuzzerCustomMutator(uint8_t *data, size_t size,     \
+            size_t max_size, unsigned int seed) {                             \
+        using protobuf_mutator::libfuzzer::CustomProtoMutator;                \
+        STAGE_TIMER(FUZZ_STAGE_MUTATION);                                     \
+        Proto input;                                                          \
+        return CustomProtoMutator(use_binary, data, size, max_size, seed,     \
+                &input);                                                      \
+    }
+
+#define DEFINE_TIMED_TEST_ONE_PROTO_INPUT_IMPL(use_binary, Proto)             \
+    extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) { \
+        using protobuf_mutator::libfuzzer::LoadProtoInput;                    \
+        STAGE_TIMER(FUZZ_STAGE_INPUT);                                        \
+        Proto input;                                                          \
+        if (LoadProtoInput(use_binary, data, size, &input))                   \
+            TestOneProtoInput(input);                                         \
+        return 0;                                                             \
+    }
+
+#define DEFINE_H2_PROTO_FUZZER(Proto, input)                                  \
+    static void TestOneProtoInput(const Proto& input);                        \
+    DEFINE_TIMED_PROTO_MUTATOR_IMPL(H2_BINARY_CORPUS, Proto)                  \
+    DEFINE_STRUCTURED_CROSSOVER_IMPL(H2_BINARY_CORPUS, Proto)                 \
+    DEFINE_TIMED_TEST_ONE_PROTO_INPUT_IMPL(H2_BINARY_CORPUS, Proto)           \
+    DEFINE_POST_PROCESS_PROTO_MUTATION_IMPL(Proto)                            \
+    static void TestOneProtoInput(const Proto& input)
@@ -0,0 +1,44 @@
+/* Differential fuzzer for the encoders themselves.
+ *
+ * Every mutated Sequence is encoded, decoded again and compared (see
+ * roundtrip_check.h); any difference aborts with a report, so libFuzzer
+ * keeps the input as a crash. No HTTP/2 target is involved. Mutated
+ * sequences are repaired by the post-processors in post_processors.h, and
+ * crossed over with CrossOver() (proto_fuzzer.h). With -DH2_FUZZ_FEATURES,
+ * encoder states count as coverage too (see encoder_features.h).
+ *
+ * Build with libprotobuf-mutator, e.g.
+ *   clang++ -std=c++20 -O1 -g -fsanitize=fuzzer,address -I. -Igenfiles \
+ *       -I$LPM -I$LPM/build/external.protobuf/include \
+ *       -DH2_FUZZ_FEATURES fuzzers/roundtrip_fuzzer.cc *.cc genfiles/h2_*.pb.cc \
+ *       -lprotobuf-mutator-libfuzzer -lprotobuf-mutator -lprotobuf
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "src/libfuzzer/libfuzzer_macro.h"
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "roundtrip_check.h"
+#include "fuzzers/post_processors.h"
+#include "fuzzers/proto_fuzzer.h"
+
+static PostProcessor<h2proto::Sequence> repair_sequence = {
+    [](h2proto::Sequence *seq, unsigned int seed) {
+        STAGE_TIMER(FUZZ_STAGE_POST_PROCESS);
+        if (repair_selected(seed))
+            RepairSequence(seq);
+    }
+};
+
+DEFINE_H2_PROTO_FUZZER(h2proto::Sequence, sequence)
+{
+    std::string report;
+
+    if (!CheckRoundTrip(sequence, &report)) {
+        fprintf(stderr, "Encoder round trip failed:\n%s", report.c_str());
+        abort();
+    }
+}
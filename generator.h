@@ -0,0 +1,82 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+/* Minimal single-pass coroutine generator (C++20 has no std::generator).
+ * Each co_yield hands the consumer a reference to the yielded object itself,
+ * which stays alive while the body is suspended, so nothing is copied and
+ * allocator-aware values (pmr buffers) keep their memory resource. The body
+ * does not resume until the consumer asks for the next element. Destroying
+ * the generator early simply abandons the rest of the body.
+ */
+template <typename T>
+class Generator {
+    public:
+    struct promise_type {
+        T *value = nullptr;
+        std::exception_ptr exception;
+
+        Generator get_return_object() {
+            return Generator(handle::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        // Temporaries in the co_yield expression outlive the suspension
+        std::suspend_always yield_value(T& v) {
+            value = std::addressof(v);
+            return {};
+        }
+        std::suspend_always yield_value(T&& v) {
+            value = std::addressof(v);
+            return {};
+        }
+
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    struct sentinel {};
+
+    struct iterator {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+
+        handle coro;
+
+        iterator& operator++() {
+            coro.resume();
+            if (coro.done() && coro.promise().exception)
+                std::rethrow_exception(coro.promise().exception);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        T& operator*() const { return *coro.promise().value; }
+        bool operator==(sentinel) const { return coro.done(); }
+    };
+
+    explicit Generator(handle h) : coro(h) {}
+    Generator(Generator&& other) noexcept : coro(std::exchange(other.coro, {})) {}
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+    ~Generator() { if (coro) coro.destroy(); }
+
+    iterator begin() {
+        iterator it { coro };
+        ++it;
+        return it;
+    }
+    sentinel end() { return {}; }
+
+    private:
+    handle coro;
+};
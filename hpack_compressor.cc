@@ -1,4 +1,5 @@
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
 #include <algorithm>
@@ -7,32 +8,41 @@
 #include "h2_sequence.pb.h"
 #include "hpack_compressor.h"
 #include "protobuf_encoders.h"
-
-/* Global HPACK instance */
-HPackCompressor hpack_compressor;
+#include "encoder_telemetry.h"
+#include "encoder_features.h"
 
 std::string HPackCompressor::compress(
-        google::protobuf::RepeatedPtrField<h2proto::HeaderField> headers)
+        const google::protobuf::RepeatedPtrField<h2proto::HeaderField>& headers)
+{
+    EncodeBuffer buf;
+    compress(headers, buf);
+
+    return std::string(buf);
+}
+
+void HPackCompressor::compress(
+        const google::protobuf::RepeatedPtrField<h2proto::HeaderField>& headers,
+        EncodeBuffer& out)
 {
-    std::string buf;
-    for (auto header : headers)
+    for (const auto& header : headers)
     {
-        h2proto::HPackString name = header.name();
-        h2proto::HPackString value = header.value();
+        const h2proto::HPackString& name = header.name();
+        const h2proto::HPackString& value = header.value();
 
-        h2proto::HPackInt magic;
-        magic.set_prefix(literal_indexing_prefixes[header.indexing()]);
-        magic.set_msb_mask(literal_indexing_msbs[header.indexing()]);
+        uint32_t magic_prefix = literal_indexing_prefixes[header.indexing()];
+        uint8_t magic_msbs = literal_indexing_msbs[header.indexing()];
 
         int header_idx = get_header_index(header);
         int name_idx = get_name_index(header);
 
         // Literal Header Field
         if (!name_idx || name.force_literal()) {
-            magic.set_value(0);
-            buf += Encode(magic);
-            buf += Encode(name);
-            buf += Encode(value);
+            append_hpack_int(out, 0, magic_prefix, magic_msbs);
+            EncodeTo(name, out);
+            EncodeTo(value, out);
+
+            TELEMETRY(telemetry_hpack_hit(TELEMETRY_HPACK_LITERAL,
+                    header.indexing() == Indexing::INCREMENTAL));
 
             if (header.indexing() == Indexing::INCREMENTAL) {
                 dynamic_table_add(header);
@@ -40,9 +50,11 @@ std::string HPackCompressor::compress(
         }
         // Indexed Name + Literal Value
         else if (name_idx && !header_idx) {
-            magic.set_value(name_idx);
-            buf += Encode(magic);
-            buf += Encode(value);
+            append_hpack_int(out, name_idx, magic_prefix, magic_msbs);
+            EncodeTo(value, out);
+
+            TELEMETRY(telemetry_hpack_hit(TELEMETRY_HPACK_NAME_INDEXED,
+                    header.indexing() == Indexing::INCREMENTAL));
 
             if (header.indexing() == Indexing::INCREMENTAL) {
                 dynamic_table_add(header);
@@ -50,65 +62,61 @@ std::string HPackCompressor::compress(
         }
         // Indexed Header Field
         else if (header_idx) {
-            h2proto::HPackInt idx;
-            idx.set_prefix(7);
-            idx.set_msb_mask(1 << 7);
-            idx.set_value(header_idx);
-            buf += Encode(idx);
+            append_hpack_int(out, header_idx, 7, 1 << 7);
+
+            TELEMETRY(telemetry_hpack_hit(TELEMETRY_HPACK_INDEXED, false));
         }
     }
-
-    return buf;
 }
 
-void HPackCompressor::dynamic_table_add(h2proto::HeaderField header)
+void HPackCompressor::dynamic_table_add(const h2proto::HeaderField& header)
 {
-    std::pair<std::string, std::string> entry = {
-        header.name().data(),
-        header.value().data()
-    };
-
-    dynamic_table.insert(dynamic_table.begin(), entry);
+    dynamic_table.emplace(dynamic_table.begin(),
+            header.name().data(), header.value().data());
 
     table_size += header.name().data().size();
     table_size += header.value().data().size();
     table_size += 32;
+    FEATURE(uint32_t evicted = 0);
 
     // Evict old entries when table gets too large
     while (table_size > max_table_size) {
         if (dynamic_table.size() < 1) {
             table_size = 0;
         } else {
-            auto evict = dynamic_table.back();
-            dynamic_table.pop_back();
+            const auto& evict = dynamic_table.back();
 
             table_size -= std::get<0>(evict).size();
             table_size -= std::get<1>(evict).size();
             table_size -= 32;
+
+            dynamic_table.pop_back();
+            TELEMETRY(telemetry_hpack_evictions(1));
+            FEATURE(evicted++);
         }
     }
+
+    FEATURE(feature_hpack_insert(table_size, max_table_size, evicted));
 }
 
-int HPackCompressor::get_header_index(h2proto::HeaderField header)
+int HPackCompressor::get_header_index(const h2proto::HeaderField& header)
 {
-    std::pair<std::string, std::string> field = {
-        header.name().data(),
-        header.value().data()
-    };
+    std::string_view name = header.name().data();
+    std::string_view value = header.value().data();
 
     // Check static table
-    {
-        auto it = find(static_table.begin(), static_table.end(), field);
-        if (it != static_table.end()) {
-            return 1 + (it - static_table.begin());
+    for (int i = 0; i < static_table.size(); i++) {
+        if (name == std::get<0>(static_table[i]) &&
+                value == std::get<1>(static_table[i])) {
+            return 1 + i;
         }
     }
 
     // Check dynamic table
-    {
-        auto it = find(dynamic_table.begin(), dynamic_table.end(), field);
-        if (it != dynamic_table.end()) {
-            return 1 + (it - dynamic_table.begin()) + static_table.size();
+    for (int i = 0; i < dynamic_table.size(); i++) {
+        if (name == std::get<0>(dynamic_table[i]) &&
+                value == std::get<1>(dynamic_table[i])) {
+            return 1 + static_table.size() + i;
         }
     }
 
@@ -116,9 +124,9 @@ int HPackCompressor::get_header_index(h2proto::HeaderField header)
 }
 
 
-int HPackCompressor::get_name_index(h2proto::HeaderField header)
+int HPackCompressor::get_name_index(const h2proto::HeaderField& header)
 {
-    std::string name = header.name().data();
+    std::string_view name = header.name().data();
 
     // Check static table
     for (int i = 0; i < static_table.size(); i++) {
@@ -1,49 +1,37 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include <utility>
+#include <memory_resource>
+
+#include "protobuf_encoders.h"
 
 struct HPackCompressor {
-    HPackCompressor() {}
+    HPackCompressor(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : dynamic_table(memory) {}
     std::string compress(
-            google::protobuf::RepeatedPtrField<h2proto::HeaderField> headers);
-    int get_header_index(h2proto::HeaderField header);
-    int get_name_index(h2proto::HeaderField header);
-    void dynamic_table_add(h2proto::HeaderField header);
+            const google::protobuf::RepeatedPtrField<h2proto::HeaderField>& headers);
+    void compress(
+            const google::protobuf::RepeatedPtrField<h2proto::HeaderField>& headers,
+            EncodeBuffer& out);
+    int get_header_index(const h2proto::HeaderField& header);
+    int get_name_index(const h2proto::HeaderField& header);
+    void dynamic_table_add(const h2proto::HeaderField& header);
     void set_max_table_size(uint32_t size);
 
     void run_tests();
 
     /* HPACK Tables */
     typedef std::vector<std::pair<std::string, std::string>> header_list;
-    header_list dynamic_table;
+    typedef std::pmr::vector<std::pair<std::pmr::string, std::pmr::string>>
+            dynamic_header_list;
+    dynamic_header_list dynamic_table;
     uint32_t max_table_size = 4096;
     uint32_t table_size = 0;
 
-    private:
-    /* Make enum nicer to work with */
-    enum Indexing {
-        INCREMENTAL = h2proto::HeaderField_Indexing_INCREMENTAL,
-        WITHOUT_INDEX = h2proto::HeaderField_Indexing_WITHOUT_INDEX,
-        NEVER_INDEXED = h2proto::HeaderField_Indexing_NEVER_INDEXED
-    };
-
-    /* Literal indexing bit patterns. */
-    static constexpr uint8_t literal_indexing_msbs[] = {
-        [Indexing::INCREMENTAL]     = 0x40,
-        [Indexing::WITHOUT_INDEX]   = 0x00,
-        [Indexing::NEVER_INDEXED]   = 0x10
-    };
-
-    static constexpr uint8_t literal_indexing_prefixes[] = {
-        [h2proto::HeaderField_Indexing_INCREMENTAL]     = 2,
-        [h2proto::HeaderField_Indexing_WITHOUT_INDEX]   = 4,
-        [h2proto::HeaderField_Indexing_NEVER_INDEXED]   = 4
-    };
-
-
     /* See RFC 7541 Appendix A */
-    const header_list static_table = {
+    static inline const header_list static_table = {
         { ":authority", "" },
         { ":method", "GET" },
         { ":method", "POST" },
@@ -106,7 +94,28 @@ struct HPackCompressor {
         { "via", "" },
         { "www-authenticate", "" },
     };
+
+    private:
+    /* Make enum nicer to work with */
+    enum Indexing {
+        INCREMENTAL = h2proto::HeaderField_Indexing_INCREMENTAL,
+        WITHOUT_INDEX = h2proto::HeaderField_Indexing_WITHOUT_INDEX,
+        NEVER_INDEXED = h2proto::HeaderField_Indexing_NEVER_INDEXED
+    };
+
+    /* Literal indexing bit patterns. */
+    static constexpr uint8_t literal_indexing_msbs[] = {
+        [Indexing::INCREMENTAL]     = 0x40,
+        [Indexing::WITHOUT_INDEX]   = 0x00,
+        [Indexing::NEVER_INDEXED]   = 0x10
+    };
+
+    static constexpr uint8_t literal_indexing_prefixes[] = {
+        [h2proto::HeaderField_Indexing_INCREMENTAL]     = 6,
+        [h2proto::HeaderField_Indexing_WITHOUT_INDEX]   = 4,
+        [h2proto::HeaderField_Indexing_NEVER_INDEXED]   = 4
+    };
 };
 
-/* Global HPACK instance */
-extern HPackCompressor hpack_compressor;
+/* Global HPACK instance, an alias for default_encoding_context.hpack */
+extern HPackCompressor &hpack_compressor;
@@ -0,0 +1,461 @@
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "hpack_decompressor.h"
+#include "huffman.h"
+
+const char *HPackDecompressor::decompress(std::string_view block,
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> *out,
+        std::vector<size_t> *ends)
+{
+    const uint8_t *begin = (const uint8_t *)block.data();
+    const uint8_t *end = begin + block.size();
+    const uint8_t *p = begin;
+
+    while (p < end) {
+        uint8_t first = *p;
+        uint64_t index;
+
+        // Dynamic Table Size Update
+        if ((first & 0xe0) == 0x20) {
+            if (!decode_hpack_int(p, end, 5, index))
+                return "truncated table size update";
+
+            max_table_size = std::min(index, (uint64_t)UINT32_MAX);
+            evict(max_table_size);
+            continue;
+        }
+
+        h2proto::HeaderField *field = out->Add();
+        h2proto::HPackString *name = field->mutable_name();
+        h2proto::HPackString *value = field->mutable_value();
+        const char *error = nullptr;
+
+        // Indexed Header Field
+        if (first & 0x80) {
+            std::string_view entry_name, entry_value;
+
+            if (!decode_hpack_int(p, end, 7, index))
+                error = "truncated index";
+            else
+                error = lookup(index, &entry_name, &entry_value);
+
+            if (error) {
+                out->RemoveLast();
+                return error;
+            }
+
+            name->set_data(entry_name.data(), entry_name.size());
+            name->set_force_literal(false);
+            name->set_huffman(false);
+            value->set_data(entry_value.data(), entry_value.size());
+            value->set_force_literal(false);
+            value->set_huffman(false);
+            field->set_indexing(h2proto::HeaderField_Indexing_WITHOUT_INDEX);
+        }
+        // Literal Header Field, with an indexed or literal name
+        else {
+            uint32_t prefix = 4;
+            auto indexing = h2proto::HeaderField_Indexing_WITHOUT_INDEX;
+
+            if (first & 0x40) {
+                prefix = 6;
+                indexing = h2proto::HeaderField_Indexing_INCREMENTAL;
+            } else if (first & 0x10) {
+                indexing = h2proto::HeaderField_Indexing_NEVER_INDEXED;
+            }
+
+            if (!decode_hpack_int(p, end, prefix, index)) {
+                error = "truncated name index";
+            } else if (!index) {
+                error = decode_hpack_string(p, end, name);
+                name->set_force_literal(true);
+            } else {
+                std::string_view entry_name, entry_value;
+                error = lookup(index, &entry_name, &entry_value);
+                name->set_data(entry_name.data(), entry_name.size());
+                name->set_force_literal(false);
+                name->set_huffman(false);
+            }
+
+            if (!error)
+                error = decode_hpack_string(p, end, value);
+
+            if (error) {
+                out->RemoveLast();
+                return error;
+            }
+
+            field->set_indexing(indexing);
+
+            if (indexing == h2proto::HeaderField_Indexing_INCREMENTAL)
+                dynamic_table_add(name->data(), value->data());
+        }
+
+        if (ends)
+            ends->push_back(p - begin);
+    }
+
+    return nullptr;
+}
+
+const char *HPackDecompressor::lookup(uint64_t index, std::string_view *name,
+        std::string_view *value)
+{
+    const auto& static_table = HPackCompressor::static_table;
+
+    if (!index)
+        return "index 0";
+
+    if (index <= static_table.size()) {
+        *name = std::get<0>(static_table[index - 1]);
+        *value = std::get<1>(static_table[index - 1]);
+        return nullptr;
+    }
+
+    index -= static_table.size() + 1;
+    if (index >= dynamic_table.size())
+        return "index past the dynamic table";
+
+    *name = std::get<0>(dynamic_table[index]);
+    *value = std::get<1>(dynamic_table[index]);
+    return nullptr;
+}
+
+/* RFC 7541 4.4: an entry larger than the table empties it and is dropped */
+void HPackDecompressor::dynamic_table_add(std::string_view name,
+        std::string_view value)
+{
+    uint32_t size = name.size() + value.size() + 32;
+
+    if (size > max_table_size) {
+        evict(0);
+        return;
+    }
+
+    evict(max_table_size - size);
+    dynamic_table.emplace(dynamic_table.begin(), name, value);
+    table_size += size;
+}
+
+void HPackDecompressor::evict(uint32_t limit)
+{
+    while (table_size > limit && !dynamic_table.empty()) {
+        const auto& entry = dynamic_table.back();
+
+        table_size -= std::get<0>(entry).size();
+        table_size -= std::get<1>(entry).size();
+        table_size -= 32;
+
+        dynamic_table.pop_back();
+    }
+}
+
+bool decode_hpack_int(const uint8_t *&p, const uint8_t *end, uint32_t prefix,
+        uint64_t& value)
+{
+    if (p >= end)
+        return false;
+
+    uint8_t max = (1 << prefix) - 1;
+    value = *p++ & max;
+    if (value < max)
+        return true;
+
+    // Continuation octets, least significant group first
+    for (int shift = 0; p < end && shift <= 56; shift += 7) {
+        uint8_t octet = *p++;
+        value += (uint64_t)(octet & 0x7f) << shift;
+
+        if (!(octet & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+const char *decode_hpack_string(const uint8_t *&p, const uint8_t *end,
+        h2proto::HPackString *str)
+{
+    if (p >= end)
+        return "truncated string";
+
+    bool huffman = *p & 0x80;
+    uint64_t length;
+
+    if (!decode_hpack_int(p, end, 7, length))
+        return "truncated string length";
+
+    if (length > (uint64_t)(end - p))
+        return "string overruns the header block";
+
+    std::string_view data((const char *)p, length);
+    p += length;
+
+    str->set_force_literal(false);
+    str->set_huffman(huffman);
+
+    if (!huffman) {
+        str->set_data(data.data(), data.size());
+        return nullptr;
+    }
+
+    std::string *out = str->mutable_data();
+    out->clear();
+
+    return huffman_decode(data, out) ? nullptr : "bad Huffman code";
+}
+
+bool huffman_decode(std::string_view data, std::string *out)
+{
+    const HuffmanDecodeTable& table = huffman_decode_table;
+    const uint8_t *p = (const uint8_t *)data.data();
+    const uint8_t *end = p + data.size();
+
+    // Shortest code is 5 bits
+    out->reserve(out->size() + data.size() * 8 / 5);
+
+    uint64_t bits = 0;
+    int nbits = 0;
+
+    for (;;) {
+        while (nbits <= 56 && p < end) {
+            bits = bits << 8 | *p++;
+            nbits += 8;
+        }
+
+        if (!nbits)
+            return true;
+
+        // Next 32 bits, left-aligned and zero-filled past the input
+        uint32_t window = nbits >= 32 ? bits >> (nbits - 32) : bits << (32 - nbits);
+
+        // The last limit is 2^32, so this always stops
+        int i = 0;
+        while (window >= table.limit[i]) i++;
+
+        int len = table.length[i];
+        if (len > nbits) {
+            // Only EOS padding may be left: under 8 bits, all ones
+            uint64_t mask = (1ull << nbits) - 1;
+            return nbits < 8 && (bits & mask) == mask;
+        }
+
+        uint16_t symbol = table.symbols[table.offset[i] +
+                (window >> (32 - len)) - table.first[i]];
+        if (symbol == 256)
+            return false;
+
+        *out += (char)symbol;
+        nbits -= len;
+    }
+}
+
+/* Decode block with hpack and compare the fields with expected */
+static void expect_fields(HPackDecompressor& hpack, std::string_view block,
+        const HPackCompressor::header_list& expected)
+{
+    google::protobuf::RepeatedPtrField<h2proto::HeaderField> fields;
+    assert(!hpack.decompress(block, &fields));
+    assert(fields.size() == (int)expected.size());
+
+    for (int i = 0; i < fields.size(); i++) {
+        assert(fields[i].name().data() == std::get<0>(expected[i]));
+        assert(fields[i].value().data() == std::get<1>(expected[i]));
+    }
+}
+
+/* Decode block and check it compresses back to the same bytes */
+static void expect_reencode(std::string_view block)
+{
+    HPackDecompressor hpack;
+    HPackCompressor compressor;
+    google::protobuf::RepeatedPtrField<h2proto::HeaderField> fields;
+
+    assert(!hpack.decompress(block, &fields));
+    assert(compressor.compress(fields) == block);
+}
+
+void HPackDecompressor::run_tests()
+{
+    // RFC7541 C.3 - Request Examples without Huffman Coding
+    {
+        HPackDecompressor _hpack;
+
+        // Request 1
+        expect_fields(_hpack, "\x82\x86\x84\x41\x0f\x77\x77\x77\x2e\x65\x78\x61\x6d\x70\x6c\x65\x2e\x63\x6f\x6d", {
+            { ":method", "GET" },
+            { ":scheme", "http" },
+            { ":path", "/" },
+            { ":authority", "www.example.com" }
+        });
+        assert(std::get<0>(_hpack.dynamic_table[0]) == ":authority");
+        assert(std::get<1>(_hpack.dynamic_table[0]) == "www.example.com");
+        assert(_hpack.table_size == 57);
+
+        // Request 2
+        expect_fields(_hpack, "\x82\x86\x84\xbe\x58\x08\x6e\x6f\x2d\x63\x61\x63\x68\x65", {
+            { ":method", "GET" },
+            { ":scheme", "http" },
+            { ":path", "/" },
+            { ":authority", "www.example.com" },
+            { "cache-control", "no-cache" }
+        });
+        assert(std::get<0>(_hpack.dynamic_table[0]) == "cache-control");
+        assert(std::get<1>(_hpack.dynamic_table[0]) == "no-cache");
+        assert(_hpack.table_size == 110);
+
+        // Request 3
+        expect_fields(_hpack, "\x82\x87\x85\xbf\x40\x0a\x63\x75\x73\x74\x6f\x6d\x2d\x6b\x65\x79\x0c\x63\x75\x73\x74\x6f\x6d\x2d\x76\x61\x6c\x75\x65", {
+            { ":method", "GET" },
+            { ":scheme", "https" },
+            { ":path", "/index.html" },
+            { ":authority", "www.example.com" },
+            { "custom-key", "custom-value" }
+        });
+        assert(std::get<0>(_hpack.dynamic_table[0]) == "custom-key");
+        assert(std::get<1>(_hpack.dynamic_table[0]) == "custom-value");
+        assert(std::get<0>(_hpack.dynamic_table[2]) == ":authority");
+        assert(_hpack.table_size == 164);
+
+        expect_reencode("\x82\x86\x84\x41\x0f\x77\x77\x77\x2e\x65\x78\x61\x6d\x70\x6c\x65\x2e\x63\x6f\x6d");
+    }
+
+    // RFC7541 C.4 - Request Examples with Huffman Coding
+    {
+        HPackDecompressor _hpack;
+
+        // Request 1
+        expect_fields(_hpack, "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff", {
+            { ":method", "GET" },
+            { ":scheme", "http" },
+            { ":path", "/" },
+            { ":authority", "www.example.com" }
+        });
+        assert(_hpack.table_size == 57);
+
+        // Request 2
+        expect_fields(_hpack, "\x82\x86\x84\xbe\x58\x86\xa8\xeb\x10\x64\x9c\xbf", {
+            { ":method", "GET" },
+            { ":scheme", "http" },
+            { ":path", "/" },
+            { ":authority", "www.example.com" },
+            { "cache-control", "no-cache" }
+        });
+        assert(_hpack.table_size == 110);
+
+        // Request 3
+        expect_fields(_hpack, "\x82\x87\x85\xbf\x40\x88\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f\x89\x25\xa8\x49\xe9\x5b\xb8\xe8\xb4\xbf", {
+            { ":method", "GET" },
+            { ":scheme", "https" },
+            { ":path", "/index.html" },
+            { ":authority", "www.example.com" },
+            { "custom-key", "custom-value" }
+        });
+        assert(std::get<0>(_hpack.dynamic_table[0]) == "custom-key");
+        assert(std::get<1>(_hpack.dynamic_table[0]) == "custom-value");
+        assert(_hpack.table_size == 164);
+
+        expect_reencode("\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff");
+    }
+
+    // RFC7541 C.6 - Response Examples with Huffman Coding, evicting from
+    // a 256 byte table
+    {
+        HPackDecompressor _hpack;
+        _hpack.max_table_size = 256;
+
+        // Response 1
+        expect_fields(_hpack, std::string_view("\x48\x82\x64\x02\x58\x85\xae\xc3\x77\x1a\x4b\x61\x96\xd0\x7a\xbe"
+                "\x94\x10\x54\xd4\x44\xa8\x20\x05\x95\x04\x0b\x81\x66\xe0\x82\xa6"
+                "\x2d\x1b\xff\x6e\x91\x9d\x29\xad\x17\x18\x63\xc7\x8f\x0b\x97\xc8"
+                "\xe9\xae\x82\xae\x43\xd3", 54), {
+            { ":status", "302" },
+            { "cache-control", "private" },
+            { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+            { "location", "https://www.example.com" }
+        });
+        assert(_hpack.dynamic_table.size() == 4);
+        assert(_hpack.table_size == 222);
+
+        // Response 2: ":status: 302" is evicted
+        expect_fields(_hpack, "\x48\x83\x64\x0e\xff\xc1\xc0\xbf", {
+            { ":status", "307" },
+            { "cache-control", "private" },
+            { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+            { "location", "https://www.example.com" }
+        });
+        assert(std::get<0>(_hpack.dynamic_table[0]) == ":status");
+        assert(std::get<1>(_hpack.dynamic_table[0]) == "307");
+        assert(_hpack.dynamic_table.size() == 4);
+        assert(_hpack.table_size == 222);
+
+        // Response 3
+        expect_fields(_hpack, "\x88\xc1\x61\x96\xd0\x7a\xbe\x94\x10\x54\xd4\x44\xa8\x20\x05\x95"
+                "\x04\x0b\x81\x66\xe0\x84\xa6\x2d\x1b\xff\xc0\x5a\x83\x9b\xd9\xab"
+                "\x77\xad\x94\xe7\x82\x1d\xd7\xf2\xe6\xc7\xb3\x35\xdf\xdf\xcd\x5b"
+                "\x39\x60\xd5\xaf\x27\x08\x7f\x36\x72\xc1\xab\x27\x0f\xb5\x29\x1f"
+                "\x95\x87\x31\x60\x65\xc0\x03\xed\x4e\xe5\xb1\x06\x3d\x50\x07", {
+            { ":status", "200" },
+            { "cache-control", "private" },
+            { "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+            { "location", "https://www.example.com" },
+            { "content-encoding", "gzip" },
+            { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" }
+        });
+        assert(std::get<0>(_hpack.dynamic_table[0]) == "set-cookie");
+        assert(std::get<0>(_hpack.dynamic_table[2]) == "date");
+        assert(_hpack.dynamic_table.size() == 3);
+        assert(_hpack.table_size == 215);
+    }
+
+    // Huffman: EOS is an error, and so is padding that is longer than 7
+    // bits or not all ones
+    {
+        std::string out;
+        assert(huffman_decode("\x1f", &out) && out == "a");
+        assert(!huffman_decode("\xff\xff\xff\xff", &out));
+        assert(!huffman_decode("\x1f\xff", &out));
+        assert(!huffman_decode("\x18", &out));
+
+        HPackDecompressor _hpack;
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> fields;
+        assert(!strcmp(_hpack.decompress("\x40\x81\xff\x00", &fields), "bad Huffman code"));
+        assert(!fields.size());
+    }
+
+    // Integers: 64 bits at most, and indexes past the tables
+    {
+        const uint8_t too_long[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 };
+        const uint8_t *p = too_long;
+        uint64_t value;
+        assert(!decode_hpack_int(p, too_long + sizeof(too_long), 7, value));
+
+        const uint8_t largest[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f };
+        p = largest;
+        assert(decode_hpack_int(p, largest + sizeof(largest), 7, value));
+        assert(value == 127 + ((1ull << 63) - 1));
+        assert(p == largest + sizeof(largest));
+
+        HPackDecompressor _hpack;
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> fields;
+        assert(!strcmp(_hpack.decompress(std::string_view((const char *)too_long, sizeof(too_long)),
+                &fields), "truncated index"));
+        assert(!strcmp(_hpack.decompress(std::string_view((const char *)largest, sizeof(largest)),
+                &fields), "index past the dynamic table"));
+        assert(!strcmp(_hpack.decompress("\x80", &fields), "index 0"));
+        assert(!strcmp(_hpack.decompress("\x40\x7f\xff\xff\xff\xff\x0f", &fields),
+                "string overruns the header block"));
+
+        // Table size updates past 2^32-1 are clamped
+        assert(!_hpack.decompress("\x3f\xe1\xff\xff\xff\xff\x01", &fields));
+        assert(_hpack.max_table_size == UINT32_MAX);
+        assert(!fields.size());
+    }
+}
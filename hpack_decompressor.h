@@ -0,0 +1,55 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+
+#include "hpack_compressor.h"
+
+/* HPACK decoder (RFC 7541), the inverse of HPackCompressor.
+ * Fields come back as HeaderField messages that re-encode to the same
+ * representation: indexed fields name a table entry, literals keep their
+ * indexing mode and force_literal when the name was sent literally, and
+ * strings remember whether they were Huffman coded. Dynamic table size
+ * updates are applied but have no grammar equivalent.
+ */
+struct HPackDecompressor {
+    HPackDecompressor(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : dynamic_table(memory) {}
+
+    /* Decode one complete header block, appending to out. If ends is given,
+     * the block offset just past each field is appended to it. Returns
+     * nullptr, or what went wrong; fields decoded before the error are kept.
+     */
+    const char *decompress(std::string_view block,
+            google::protobuf::RepeatedPtrField<h2proto::HeaderField> *out,
+            std::vector<size_t> *ends = nullptr);
+
+    void run_tests();
+
+    /* Newest first, like HPackCompressor's, but inserting at the front
+     * does not move every other entry
+     */
+    std::pmr::deque<std::pair<std::pmr::string, std::pmr::string>> dynamic_table;
+    uint32_t max_table_size = 4096;
+    uint32_t table_size = 0;
+
+    private:
+    const char *lookup(uint64_t index, std::string_view *name,
+            std::string_view *value);
+    void dynamic_table_add(std::string_view name, std::string_view value);
+    void evict(uint32_t limit);
+};
+
+/* Read an HPACK integer with a prefix-bit prefix, advancing p */
+bool decode_hpack_int(const uint8_t *&p, const uint8_t *end, uint32_t prefix,
+        uint64_t& value);
+
+/* Read a length-prefixed HPACK string into str, advancing p */
+const char *decode_hpack_string(const uint8_t *&p, const uint8_t *end,
+        h2proto::HPackString *str);
+
+/* Append the Huffman decoding of data to out; false if it is malformed */
+bool huffman_decode(std::string_view data, std::string *out);
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "protobuf_encoders.h"
+#include "encoding_context.h"
+#include "encode_arena.h"
+#include "parallel_encoder.h"
+
+/* Conversations handed out per steal */
+#define PARALLEL_ENCODE_GRAIN 64
+
+/* Half-open ranges of conversation indices owned by one worker. The owner
+ * takes from the front, thieves take from the back.
+ */
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<std::pair<size_t, size_t>> ranges;
+
+    bool pop(std::pair<size_t, size_t>& range) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (ranges.empty()) return false;
+        range = ranges.front();
+        ranges.pop_front();
+        return true;
+    }
+
+    bool steal(std::pair<size_t, size_t>& range) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (ranges.empty()) return false;
+        range = ranges.back();
+        ranges.pop_back();
+        return true;
+    }
+};
+
+std::vector<std::string> EncodeConversationsParallel(
+        const std::vector<h2proto::Conversation>& conversations,
+        unsigned threads,
+        const std::function<void(EncodingContext&)>& setup)
+{
+    std::vector<std::string> results(conversations.size());
+
+    if (!threads)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    size_t chunks = (conversations.size() + PARALLEL_ENCODE_GRAIN - 1) /
+            PARALLEL_ENCODE_GRAIN;
+    threads = std::min<size_t>(threads, std::max<size_t>(chunks, 1));
+
+    // Deal chunks round-robin so every worker starts with local work
+    std::vector<WorkQueue> queues(threads);
+    for (size_t i = 0; i < chunks; i++) {
+        size_t begin = i * PARALLEL_ENCODE_GRAIN;
+        size_t end = std::min(begin + PARALLEL_ENCODE_GRAIN, conversations.size());
+        queues[i % threads].ranges.emplace_back(begin, end);
+    }
+
+    std::exception_ptr error;
+    std::mutex error_lock;
+
+    auto worker = [&](unsigned self) {
+        EncodeArena arena;
+        std::pair<size_t, size_t> range;
+
+        auto next = [&]() {
+            if (queues[self].pop(range))
+                return true;
+
+            for (unsigned i = 1; i < threads; i++) {
+                if (queues[(self + i) % threads].steal(range))
+                    return true;
+            }
+
+            return false;
+        };
+
+        try {
+            while (next()) {
+                for (size_t i = range.first; i < range.second; i++) {
+                    {
+                        EncodingContext ctx(arena.resource());
+                        if (setup) setup(ctx);
+
+                        EncodeBuffer out(arena.resource());
+                        EncodeTo(conversations[i], out, ctx);
+                        results[i].assign(out.data(), out.size());
+                    }
+
+                    arena.reset();
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++)
+        pool.emplace_back(worker, i);
+
+    worker(0);
+
+    for (auto& thread : pool)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return results;
+}
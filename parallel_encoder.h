@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct EncodingContext;
+
+/* Encode a corpus of conversations, each as its own connection, across a
+ * work-stealing thread pool. results[i] always holds the encoding of
+ * conversations[i], so the output does not depend on the thread count.
+ * setup, if given, configures every fresh context (framing policy,
+ * preface, ...) before its conversation is encoded.
+ */
+std::vector<std::string> EncodeConversationsParallel(
+        const std::vector<h2proto::Conversation>& conversations,
+        unsigned threads = 0,
+        const std::function<void(EncodingContext&)>& setup = nullptr);
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <random>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "priority_tree.h"
+#include "protobuf_encoders.h"
+#include "encoder_features.h"
+
+uint32_t PriorityTree::parent(uint32_t stream_id) const
+{
+    auto it = nodes.find(stream_id);
+    return it != nodes.end() ? it->second.parent : 0;
+}
+
+uint32_t PriorityTree::depth(uint32_t stream_id) const
+{
+    uint32_t depth = 0;
+    for (; stream_id && nodes.count(stream_id); stream_id = parent(stream_id))
+        depth++;
+    return depth;
+}
+
+uint32_t PriorityTree::fan_out(uint32_t stream_id) const
+{
+    auto it = nodes.find(stream_id);
+    return it != nodes.end() ? it->second.children.size() : 0;
+}
+
+bool PriorityTree::descends_from(uint32_t stream_id, uint32_t ancestor) const
+{
+    for (; stream_id; stream_id = parent(stream_id)) {
+        if (stream_id == ancestor)
+            return true;
+    }
+    return !ancestor;
+}
+
+/* The node of stream_id, added under the root if it is not in the tree.
+ * References stay valid across rehashes.
+ */
+PriorityNode& PriorityTree::node(uint32_t stream_id)
+{
+    auto [it, added] = nodes.try_emplace(stream_id);
+    PriorityNode& n = it->second;
+
+    if (added && stream_id)
+        node(0).children.push_back(stream_id);
+    return n;
+}
+
+void PriorityTree::move(uint32_t stream_id, uint32_t parent)
+{
+    PriorityNode& n = node(stream_id);
+    if (n.parent == parent)
+        return;
+
+    auto& siblings = node(n.parent).children;
+    siblings.erase(std::find(siblings.begin(), siblings.end(), stream_id));
+
+    node(parent).children.push_back(stream_id);
+    n.parent = parent;
+}
+
+PriorityReport PriorityTree::prioritize(uint32_t stream_id, uint32_t dependency,
+        uint32_t weight, bool exclusive)
+{
+    PriorityReport report;
+    if (!stream_id)
+        return report;
+
+    prioritizations++;
+
+    // A stream error (5.3.1): servers must not touch the tree
+    if (dependency == stream_id) {
+        self_dependencies++;
+        report.self_dependency = true;
+        FEATURE(feature_priority(report));
+        return report;
+    }
+
+    placeholders += dependency && !nodes.count(dependency);
+    node(dependency);
+    PriorityNode& n = node(stream_id);
+
+    if (dependency && descends_from(dependency, stream_id)) {
+        move(dependency, n.parent);
+        report.cycle = true;
+        cycles++;
+    }
+
+    move(stream_id, dependency);
+    n.weight = std::min(weight, (uint32_t)255) + 1;
+
+    // The new parent's other children move below the stream (5.3.1)
+    if (exclusive) {
+        PriorityNode& p = node(dependency);
+
+        for (uint32_t child : p.children) {
+            if (child == stream_id)
+                continue;
+            nodes.find(child)->second.parent = stream_id;
+            n.children.push_back(child);
+            report.adopted++;
+        }
+
+        p.children.assign(1, stream_id);
+        exclusive_moves += report.adopted;
+    }
+
+    report.depth = depth(stream_id);
+    report.fan_out = fan_out(dependency);
+    max_depth = std::max(max_depth, report.depth);
+    max_fan_out = std::max(max_fan_out, report.fan_out);
+    FEATURE(feature_priority(report));
+    return report;
+}
+
+void PriorityTree::update(const h2proto::Frame& frame)
+{
+    if (!tracked)
+        return;
+
+    if (frame.has_headers_frame()) {
+        const h2proto::HeadersFrame& headers = frame.headers_frame();
+        uint32_t id = headers.stream_id();
+
+        if (id && headers.priority())
+            prioritize(id, headers.stream_dependency() & MAX_INT_31,
+                    headers.weight(), headers.exclusive());
+        else if (id)
+            node(id);
+    }
+    else if (frame.has_priority_frame()) {
+        const h2proto::PriorityFrame& priority = frame.priority_frame();
+
+        // PRIORITY on stream 0 is a connection error (6.3)
+        if (priority.stream_id())
+            prioritize(priority.stream_id(), priority.stream_dependency() & MAX_INT_31,
+                    priority.weight(), priority.exclusive());
+    }
+}
+
+static void add_priority_frame(h2proto::Sequence *seq, uint32_t stream_id,
+        uint32_t dependency, uint32_t weight, bool exclusive)
+{
+    h2proto::PriorityFrame *frame = seq->add_frames()->mutable_priority_frame();
+    frame->set_stream_id(stream_id);
+    frame->set_stream_dependency(dependency);
+    frame->set_weight(weight);
+    frame->set_exclusive(exclusive);
+}
+
+/* The i-th odd stream ID from first_stream on, 0 once they run out */
+static uint32_t nth_stream(uint32_t first_stream, uint64_t i)
+{
+    uint64_t id = (first_stream | 1) + 2 * i;
+    return id <= MAX_INT_31 ? id : 0;
+}
+
+void AppendPriorityChain(h2proto::Sequence *seq, uint32_t first_stream,
+        uint32_t depth)
+{
+    uint32_t previous = 0;
+
+    for (uint32_t i = 0; i < depth; i++) {
+        uint32_t id = nth_stream(first_stream, i);
+        if (!id)
+            break;
+
+        add_priority_frame(seq, id, previous, H2_DEFAULT_WEIGHT - 1, false);
+        previous = id;
+    }
+}
+
+void AppendExclusiveFan(h2proto::Sequence *seq, uint32_t first_stream,
+        uint32_t width, uint32_t rounds)
+{
+    uint32_t holder = nth_stream(first_stream, 0);
+    if (!holder)
+        return;
+
+    add_priority_frame(seq, holder, 0, H2_DEFAULT_WEIGHT - 1, false);
+
+    uint64_t i = 1;
+    for (; i <= width && nth_stream(first_stream, i); i++)
+        add_priority_frame(seq, nth_stream(first_stream, i), holder, i % 256, false);
+
+    for (uint32_t round = 0; round < rounds; round++, i++) {
+        uint32_t id = nth_stream(first_stream, i);
+        if (!id)
+            break;
+
+        add_priority_frame(seq, id, holder, H2_DEFAULT_WEIGHT - 1, true);
+        holder = id;
+    }
+}
+
+void AppendReprioritizationStorm(h2proto::Sequence *seq, uint32_t first_stream,
+        uint32_t streams, uint32_t rounds, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    PriorityTree tree;
+
+    uint32_t last = 0;
+    while (last < streams && nth_stream(first_stream, last))
+        last++;
+    if (last < 2)
+        return;
+
+    for (uint32_t round = 0; round < rounds; round++) {
+        uint32_t stream_id = nth_stream(first_stream, rng() % last);
+        uint32_t dependency = nth_stream(first_stream, rng() % last);
+
+        // Climb from the dependency so the stream becomes its ancestor
+        if (rng() & 1) {
+            uint32_t up = rng() % 4 + 1;
+            for (uint32_t p = tree.parent(dependency); up-- && p; p = tree.parent(p))
+                stream_id = p;
+        }
+
+        if (stream_id == dependency)
+            dependency = 0;
+
+        uint32_t weight = rng() % 256;
+        bool exclusive = rng() & 1;
+
+        tree.prioritize(stream_id, dependency, weight, exclusive);
+        add_priority_frame(seq, stream_id, dependency, weight, exclusive);
+    }
+}
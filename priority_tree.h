@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+/* RFC 7540 5.3.5 */
+#define H2_DEFAULT_WEIGHT 16
+
+/* One stream in the dependency tree. weight is the real weight (1-256),
+ * i.e. the wire byte plus one.
+ */
+struct PriorityNode {
+    using allocator_type = std::pmr::polymorphic_allocator<uint32_t>;
+
+    PriorityNode(const allocator_type& alloc = {}) : children(alloc) {}
+    PriorityNode(const PriorityNode& other, const allocator_type& alloc)
+        : parent(other.parent), weight(other.weight), children(other.children, alloc) {}
+
+    uint32_t parent = 0;
+    uint32_t weight = H2_DEFAULT_WEIGHT;
+    std::pmr::vector<uint32_t> children;
+};
+
+/* What one prioritization did to the tree */
+struct PriorityReport {
+    // The stream depended on itself: a stream error, the tree is unchanged
+    bool self_dependency = false;
+
+    // The new parent was a descendant of the stream, so it was first moved
+    // up to the stream's old parent (5.3.3). A server that skips this step
+    // builds a cycle.
+    bool cycle = false;
+
+    // Children adopted from the new parent by an exclusive dependency
+    uint32_t adopted = 0;
+
+    // Of the stream, and of its new parent, afterwards
+    uint32_t depth = 0;
+    uint32_t fan_out = 0;
+};
+
+/* Incremental model of the priority tree of one connection (RFC 7540 5.3),
+ * fed with the HEADERS and PRIORITY frames we send. Streams are never
+ * removed: we cannot see when the peer is done with them, and servers
+ * are allowed to keep closed streams in the tree anyway (5.3.4).
+ * Dependencies on streams not in the tree add them under the root with
+ * the default weight, as servers that accept PRIORITY on idle streams do.
+ */
+struct PriorityTree {
+    PriorityTree(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : nodes(memory) {}
+
+    uint32_t parent(uint32_t stream_id) const;
+    uint32_t depth(uint32_t stream_id) const;
+    uint32_t fan_out(uint32_t stream_id) const;
+    bool descends_from(uint32_t stream_id, uint32_t ancestor) const;
+
+    /* Give stream_id a new priority, adding it if needed. weight is the
+     * wire byte (0-255).
+     */
+    PriorityReport prioritize(uint32_t stream_id, uint32_t dependency,
+            uint32_t weight, bool exclusive);
+
+    /* Prioritize for a HEADERS (with the PRIORITY flag) or PRIORITY frame
+     * that is sent. New streams opened without priority get the default.
+     * Does nothing unless tracked.
+     */
+    void update(const h2proto::Frame& frame);
+
+    bool tracked = false;
+
+    // Stream 0 is the root and always present
+    std::pmr::unordered_map<uint32_t, PriorityNode> nodes;
+
+    uint64_t prioritizations = 0;
+    uint64_t self_dependencies = 0;
+    uint64_t cycles = 0;
+    uint64_t exclusive_moves = 0;
+    uint64_t placeholders = 0;
+    uint32_t max_depth = 0;
+    uint32_t max_fan_out = 0;
+
+    private:
+    PriorityNode& node(uint32_t stream_id);
+    void move(uint32_t stream_id, uint32_t parent);
+};
+
+/* Stress shapes, as PRIORITY frames on odd stream IDs from first_stream on.
+ * They only need the streams to be idle, so they work without opening
+ * anything and are not limited by SETTINGS_MAX_CONCURRENT_STREAMS.
+ */
+
+/* Every stream depends on the one before: depth streams deep */
+void AppendPriorityChain(h2proto::Sequence *seq, uint32_t first_stream,
+        uint32_t depth);
+
+/* width streams under first_stream, then rounds new streams each taking
+ * the whole fan with an exclusive dependency on the previous holder, so
+ * every round re-parents width streams
+ */
+void AppendExclusiveFan(h2proto::Sequence *seq, uint32_t first_stream,
+        uint32_t width, uint32_t rounds);
+
+/* rounds reprioritizations among streams streams with random weights and
+ * exclusive flags. About half make a stream depend on one of its own
+ * descendants, which forces the 5.3.3 rearrangement.
+ */
+void AppendReprioritizationStorm(h2proto::Sequence *seq, uint32_t first_stream,
+        uint32_t streams, uint32_t rounds, unsigned seed);
@@ -0,0 +1,465 @@
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "protobuf_decoders.h"
+#include "protobuf_encoders.h"
+#include "connection_preface.h"
+#include "frame_dispatch.h"
+#include "byte_order.h"
+
+/* Strip Pad Length and padding from a PADDED payload */
+static bool unpad(std::string_view& payload, uint32_t *pad_length)
+{
+    if (payload.empty())
+        return false;
+
+    *pad_length = (uint8_t)payload[0];
+    if (*pad_length > payload.size() - 1)
+        return false;
+
+    payload = payload.substr(1, payload.size() - 1 - *pad_length);
+    return true;
+}
+
+/* Fills in the grammar message picked by the frame type.
+ * Returns false if the frame is malformed and should be dropped.
+ */
+struct PayloadDecoder {
+    FrameDecoder& decoder;
+    const RawFrame& raw;
+
+    bool fail(DecodeError::Code code, const char *what) {
+        decoder.error(code, raw, what);
+        return false;
+    }
+
+    /* Frame Type 0: DATA */
+    bool operator()(h2proto::DataFrame& f) {
+        std::string_view payload = raw.payload;
+        uint32_t pad_length;
+
+        if (raw.flags & 0x8) {
+            if (!unpad(payload, &pad_length))
+                return fail(DecodeError::PROTOCOL_ERROR, "padding exceeds payload");
+            f.set_pad_length(pad_length);
+        }
+
+        f.set_data(payload.data(), payload.size());
+        f.set_end_stream(raw.flags & 0x1);
+        f.set_stream_id(raw.stream_id);
+        return true;
+    }
+
+    /* Frame Type 1: HEADERS */
+    bool operator()(h2proto::HeadersFrame& f) {
+        std::string_view payload = raw.payload;
+        uint32_t pad_length;
+
+        if (raw.flags & 0x8) {
+            if (!unpad(payload, &pad_length))
+                return fail(DecodeError::PROTOCOL_ERROR, "padding exceeds payload");
+            f.set_pad_length(pad_length);
+        }
+
+        bool priority = raw.flags & 0x20;
+        uint32_t dependency = 0;
+        uint32_t weight = 0;
+
+        if (priority) {
+            if (payload.size() < 5)
+                return fail(DecodeError::FRAME_SIZE_ERROR, "priority fields truncated");
+
+            dependency = load_be32(payload.data());
+            weight = (uint8_t)payload[4];
+            payload.remove_prefix(5);
+        }
+
+        f.set_exclusive(dependency >> 31);
+        f.set_stream_dependency(dependency & MAX_INT_31);
+        f.set_weight(weight);
+        f.set_end_stream(raw.flags & 0x1);
+        f.set_end_headers(raw.flags & 0x4);
+        f.set_priority(priority);
+        f.set_stream_id(raw.stream_id);
+
+        decoder.header_block(raw, payload, f.mutable_header_list(),
+                f.end_headers(), true);
+        return true;
+    }
+
+    /* Frame Type 2: PRIORITY */
+    bool operator()(h2proto::PriorityFrame& f) {
+        if (raw.length != 5)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "PRIORITY length is not 5");
+
+        uint32_t dependency = load_be32(raw.payload.data());
+        f.set_exclusive(dependency >> 31);
+        f.set_stream_dependency(dependency & MAX_INT_31);
+        f.set_weight((uint8_t)raw.payload[4]);
+        f.set_stream_id(raw.stream_id);
+        return true;
+    }
+
+    /* Frame Type 3: RST_STREAM */
+    bool operator()(h2proto::RstStreamFrame& f) {
+        if (raw.length != 4)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "RST_STREAM length is not 4");
+
+        f.set_error_code(load_be32(raw.payload.data()));
+        f.set_stream_id(raw.stream_id);
+        return true;
+    }
+
+    /* Frame Type 4: SETTINGS */
+    bool operator()(h2proto::SettingsFrame& f) {
+        f.set_ack(raw.flags & 0x1);
+
+        if (f.ack()) {
+            if (raw.length)
+                return fail(DecodeError::FRAME_SIZE_ERROR, "SETTINGS ACK with a payload");
+            return true;
+        }
+
+        if (raw.length % 6)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "SETTINGS length not a multiple of 6");
+
+        // Later values of a parameter win; unknown parameters are ignored
+        for (size_t i = 0; i < raw.length; i += 6) {
+            uint16_t id = load_be16(raw.payload.data() + i);
+            uint32_t value = load_be32(raw.payload.data() + i + 2);
+
+            switch (id) {
+                case 1: f.set_header_table_size(value); break;
+                case 2: f.set_enable_push(value); break;
+                case 3: f.set_max_concurrent_streams(value); break;
+                case 4: f.set_initial_window_size(value); break;
+                case 5: f.set_max_frame_size(value); break;
+                case 6: f.set_max_header_list_size(value); break;
+            }
+        }
+
+        return true;
+    }
+
+    /* Frame Type 5: PUSH_PROMISE */
+    bool operator()(h2proto::PushPromiseFrame& f) {
+        std::string_view payload = raw.payload;
+        uint32_t pad_length;
+
+        if (raw.flags & 0x8) {
+            if (!unpad(payload, &pad_length))
+                return fail(DecodeError::PROTOCOL_ERROR, "padding exceeds payload");
+            f.set_pad_length(pad_length);
+        }
+
+        if (payload.size() < 4)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "promised stream ID truncated");
+
+        f.set_promised_stream_id(load_be32(payload.data()) & MAX_INT_31);
+        f.set_end_headers(raw.flags & 0x4);
+        f.set_stream_id(raw.stream_id);
+
+        decoder.header_block(raw, payload.substr(4), f.mutable_header_list(),
+                f.end_headers(), true);
+        return true;
+    }
+
+    /* Frame Type 6: PING */
+    bool operator()(h2proto::PingFrame& f) {
+        if (raw.length != 8)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "PING length is not 8");
+
+        f.set_opaque_data_lo(load_be32(raw.payload.data()));
+        f.set_opaque_data_hi(load_be32(raw.payload.data() + 4));
+        f.set_ack(raw.flags & 0x1);
+        return true;
+    }
+
+    /* Frame Type 7: GOAWAY */
+    bool operator()(h2proto::GoawayFrame& f) {
+        if (raw.length < 8)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "GOAWAY shorter than 8");
+
+        f.set_last_stream_id(load_be32(raw.payload.data()) & MAX_INT_31);
+        f.set_error_code(load_be32(raw.payload.data() + 4));
+
+        if (raw.length > 8)
+            f.set_opaque_data(raw.payload.data() + 8, raw.length - 8);
+        return true;
+    }
+
+    /* Frame Type 8: WINDOW_UPDATE */
+    bool operator()(h2proto::WindowUpdateFrame& f) {
+        if (raw.length != 4)
+            return fail(DecodeError::FRAME_SIZE_ERROR, "WINDOW_UPDATE length is not 4");
+
+        f.set_window_size_increment(load_be32(raw.payload.data()) & MAX_INT_31);
+        return true;
+    }
+
+    /* Frame Type 9: CONTINUATION */
+    bool operator()(h2proto::ContinuationFrame& f) {
+        f.set_end_headers(raw.flags & 0x4);
+        f.set_stream_id(raw.stream_id);
+
+        decoder.header_block(raw, raw.payload, f.mutable_header_list(),
+                f.end_headers(), false);
+        return true;
+    }
+};
+
+size_t FrameDecoder::decode(std::string_view buf, h2proto::Sequence *seq)
+{
+    size_t offset = 0;
+
+    if (expect_preface) {
+        std::string_view magic = H2_CLIENT_PREFACE;
+
+        // Wait until it is clear whether the stream starts with the preface
+        if (buf.size() < magic.size() && magic.starts_with(buf))
+            return 0;
+
+        if (buf.starts_with(magic))
+            offset = magic.size();
+        expect_preface = false;
+    }
+
+    while (buf.size() - offset >= H2_FRAME_HEADER_SIZE) {
+        const char *header = buf.data() + offset;
+        uint32_t length = load_be24(header);
+
+        if (buf.size() - offset - H2_FRAME_HEADER_SIZE < length)
+            break;
+
+        RawFrame raw = {
+            .length = length,
+            .type = (uint8_t)header[3],
+            .flags = (uint8_t)header[4],
+            .stream_id = load_be32(header + 5) & MAX_INT_31,
+            .payload = std::string_view(header + H2_FRAME_HEADER_SIZE, length),
+            .offset = position + offset
+        };
+        offset += H2_FRAME_HEADER_SIZE + length;
+
+        decode_frame(raw, seq);
+    }
+
+    position += offset;
+    return offset;
+}
+
+bool FrameDecoder::decode_frame(const RawFrame& raw, h2proto::Sequence *seq)
+{
+    if (block_open && raw.type != 9) {
+        error(DecodeError::PROTOCOL_ERROR, raw, "header block interrupted");
+        flush_header_block();
+    }
+
+    if (raw.type >= num_frame_types) {
+        error(DecodeError::UNKNOWN_FRAME_TYPE, raw, "no grammar message for this type");
+        return false;
+    }
+
+    h2proto::Frame *frame = seq->add_frames();
+    if (!VisitFrame(frame, frame_oneof_cases[raw.type], PayloadDecoder{*this, raw})) {
+        seq->mutable_frames()->RemoveLast();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameDecoder::finish(std::string_view rest)
+{
+    if (block_open) {
+        error(DecodeError::PROTOCOL_ERROR, block_frame, "header block never ended");
+        flush_header_block();
+    }
+
+    if (!rest.empty()) {
+        errors.push_back({ DecodeError::TRUNCATED, position,
+                (uint8_t)(rest.size() > 3 ? rest[3] : 0xff),
+                rest.size() >= H2_FRAME_HEADER_SIZE ? load_be32(rest.data() + 5) & MAX_INT_31 : 0,
+                "input ends inside a frame" });
+    }
+}
+
+void FrameDecoder::error(DecodeError::Code code, const RawFrame& frame,
+        const char *what)
+{
+    errors.push_back({ code, frame.offset, frame.type, frame.stream_id, what });
+}
+
+void FrameDecoder::header_block(const RawFrame& frame, std::string_view fragment,
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> *fields,
+        bool end_headers, bool first)
+{
+    // A stray CONTINUATION is taken as the start of a block of its own
+    if (!first && !block_open) {
+        error(DecodeError::PROTOCOL_ERROR, frame, "CONTINUATION without a header block");
+        first = true;
+    } else if (!first && frame.stream_id != block_frame.stream_id) {
+        error(DecodeError::PROTOCOL_ERROR, frame, "CONTINUATION on another stream");
+    }
+
+    // Whole block in one frame: decode straight out of the input
+    if (first && end_headers) {
+        if (const char *what = hpack.decompress(fragment, fields))
+            error(DecodeError::COMPRESSION_ERROR, frame, what);
+        return;
+    }
+
+    if (first) {
+        block.assign(fragment);
+        block_fragments.clear();
+        block_frame = frame;
+        block_open = true;
+    } else {
+        block.append(fragment);
+    }
+
+    block_fragments.push_back({ fields, block.size() });
+
+    if (end_headers)
+        flush_header_block();
+}
+
+void FrameDecoder::flush_header_block()
+{
+    google::protobuf::RepeatedPtrField<h2proto::HeaderField> fields;
+    std::vector<size_t> ends;
+
+    if (const char *what = hpack.decompress(block, &fields, &ends))
+        error(DecodeError::COMPRESSION_ERROR, block_frame, what);
+
+    // A field belongs to the fragment its encoding ends in
+    size_t j = 0;
+    for (int i = 0; i < fields.size(); i++) {
+        while (j + 1 < block_fragments.size() && ends[i] > block_fragments[j].end)
+            j++;
+        block_fragments[j].fields->Add()->Swap(fields.Mutable(i));
+    }
+
+    block.clear();
+    block_fragments.clear();
+    block_open = false;
+}
+
+bool DecodeSequence(std::string_view buf, h2proto::Sequence *seq,
+        std::vector<DecodeError> *errors)
+{
+    FrameDecoder decoder;
+
+    size_t used = decoder.decode(buf, seq);
+    decoder.finish(buf.substr(used));
+
+    bool ok = decoder.errors.empty();
+    if (errors)
+        errors->insert(errors->end(), decoder.errors.begin(), decoder.errors.end());
+
+    return ok;
+}
+
+/* A frame header and payload, as the decoder reads it */
+static std::string raw_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+        std::string_view payload)
+{
+    std::string frame(H2_FRAME_HEADER_SIZE, '\0');
+    store_be32(&frame[0], payload.size() << 8 | type);
+    frame[4] = flags;
+    store_be32(&frame[5], stream_id);
+    return frame.append(payload);
+}
+
+void FrameDecoder::run_tests()
+{
+    // Every structured error, each after a good frame that is kept
+    {
+        const std::string ping = raw_frame(6, 0, 0, std::string(8, '\0'));
+
+        const struct {
+            std::string input;
+            DecodeError::Code code;
+            const char *what;
+            int frames;
+            size_t offset = 0;  // Of the frame in error, within input
+        } cases[] = {
+            { ping.substr(0, 13),
+                    DecodeError::TRUNCATED, "input ends inside a frame", 0 },
+            { raw_frame(0, 0x8, 1, "\x05" "abc"),
+                    DecodeError::PROTOCOL_ERROR, "padding exceeds payload", 0 },
+            { raw_frame(0, 0x8, 1, ""),
+                    DecodeError::PROTOCOL_ERROR, "padding exceeds payload", 0 },
+            { raw_frame(1, 0xc, 1, std::string("\x02\x82", 2)),
+                    DecodeError::PROTOCOL_ERROR, "padding exceeds payload", 0 },
+            { raw_frame(1, 0x24, 1, std::string("\0\0\0", 3)),
+                    DecodeError::FRAME_SIZE_ERROR, "priority fields truncated", 0 },
+            { raw_frame(2, 0, 1, std::string(4, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "PRIORITY length is not 5", 0 },
+            { raw_frame(3, 0, 1, std::string(5, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "RST_STREAM length is not 4", 0 },
+            { raw_frame(4, 0x1, 0, std::string(6, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "SETTINGS ACK with a payload", 0 },
+            { raw_frame(4, 0, 0, std::string(7, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "SETTINGS length not a multiple of 6", 0 },
+            { raw_frame(5, 0x4, 1, std::string(3, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "promised stream ID truncated", 0 },
+            { raw_frame(5, 0xc, 1, std::string("\x05\0\0\0\x02", 5)),
+                    DecodeError::PROTOCOL_ERROR, "padding exceeds payload", 0 },
+            { raw_frame(6, 0, 0, std::string(9, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "PING length is not 8", 0 },
+            { raw_frame(7, 0, 0, std::string(7, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "GOAWAY shorter than 8", 0 },
+            { raw_frame(8, 0, 0, std::string(5, '\0')),
+                    DecodeError::FRAME_SIZE_ERROR, "WINDOW_UPDATE length is not 4", 0 },
+            { raw_frame(0xa, 0, 0, "origin"),
+                    DecodeError::UNKNOWN_FRAME_TYPE, "no grammar message for this type", 0 },
+            { raw_frame(1, 0x4, 1, "\x80"),
+                    DecodeError::COMPRESSION_ERROR, "index 0", 1 },
+
+            // The HEADERS and the interrupting PING are both kept
+            { raw_frame(1, 0, 1, "\x82") + ping,
+                    DecodeError::PROTOCOL_ERROR, "header block interrupted", 2, 10 },
+            { raw_frame(1, 0, 1, "\x82"),
+                    DecodeError::PROTOCOL_ERROR, "header block never ended", 1 },
+            { raw_frame(9, 0x4, 1, "\x82"),
+                    DecodeError::PROTOCOL_ERROR, "CONTINUATION without a header block", 1 },
+            { raw_frame(1, 0, 1, "\x82") + raw_frame(9, 0x4, 3, "\x84"),
+                    DecodeError::PROTOCOL_ERROR, "CONTINUATION on another stream", 2, 10 }
+        };
+
+        for (const auto& c : cases) {
+            h2proto::Sequence seq;
+            std::vector<DecodeError> errors;
+
+            assert(!DecodeSequence(ping + c.input, &seq, &errors));
+            assert(errors.size() == 1);
+            assert(errors[0].code == c.code);
+            assert(!strcmp(errors[0].what, c.what));
+            assert(errors[0].offset == ping.size() + c.offset);
+            assert(seq.frames_size() == 1 + c.frames);
+        }
+    }
+
+    // Header block split over CONTINUATION: each field goes to the frame
+    // its encoding ends in
+    {
+        std::string input = H2_CLIENT_PREFACE;
+        input += raw_frame(1, 0, 1, "\x82\x86\x41\x0f\x77\x77\x77");
+        input += raw_frame(9, 0x4, 1, "\x2e\x65\x78\x61\x6d\x70\x6c\x65\x2e\x63\x6f\x6d\x84");
+
+        h2proto::Sequence seq;
+        assert(DecodeSequence(input, &seq));
+        assert(seq.frames_size() == 2);
+        assert(seq.frames(0).headers_frame().header_list_size() == 2);
+        assert(seq.frames(1).continuation_frame().header_list_size() == 2);
+        assert(seq.frames(1).continuation_frame().header_list(0).value().data() ==
+                "www.example.com");
+    }
+}
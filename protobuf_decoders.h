@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+
+#include "hpack_decompressor.h"
+
+/* A frame as it sits in the input. The payload points into the caller's
+ * buffer; nothing is copied until a grammar message is filled in.
+ */
+struct RawFrame {
+    uint32_t length;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t stream_id;     // Reserved bit cleared
+    std::string_view payload;
+    size_t offset;          // Of the frame header, from the start of input
+};
+
+/* Something in the input the grammar could not take as-is */
+struct DecodeError {
+    enum Code {
+        TRUNCATED,              // Input ends inside a frame
+        FRAME_SIZE_ERROR,       // Payload length wrong for the frame type
+        PROTOCOL_ERROR,         // Bad padding, misplaced CONTINUATION, ...
+        COMPRESSION_ERROR,      // Undecodable HPACK block
+        UNKNOWN_FRAME_TYPE      // No grammar message for the type; skipped
+    };
+
+    Code code;
+    size_t offset;
+    uint8_t type;
+    uint32_t stream_id;
+    const char *what;
+};
+
+static constexpr const char *decode_error_names[] = {
+    "TRUNCATED", "FRAME_SIZE_ERROR", "PROTOCOL_ERROR", "COMPRESSION_ERROR",
+    "UNKNOWN_FRAME_TYPE"
+};
+
+/* Inverse of Encode<h2proto::Sequence>.
+ * Walks the frame headers of a raw HTTP/2 byte stream and appends one Frame
+ * per wire frame to a Sequence, keeping padding, priority fields, SETTINGS
+ * parameters and HPACK header blocks. A leading client preface is skipped.
+ * Malformed frames are dropped and recorded in errors; decoding continues
+ * with the next frame. Header blocks split over CONTINUATION frames are
+ * decoded as a whole, and each field goes to the frame its encoding ends in.
+ *
+ * Input may arrive in pieces: decode() returns the bytes it used, and the
+ * remainder is fed again with more data. Frames of an unfinished header
+ * block are held by pointer, so seq must outlive the decoder or finish().
+ */
+struct FrameDecoder {
+    FrameDecoder(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : hpack(memory), block(memory) {}
+
+    size_t decode(std::string_view buf, h2proto::Sequence *seq);
+
+    /* Append one frame to seq; false if it was dropped */
+    bool decode_frame(const RawFrame& frame, h2proto::Sequence *seq);
+
+    /* End of input. rest is whatever decode() left unconsumed. */
+    void finish(std::string_view rest = {});
+
+    void error(DecodeError::Code code, const RawFrame& frame, const char *what);
+
+    /* Add a header block fragment of a HEADERS/PUSH_PROMISE (first) or
+     * CONTINUATION frame whose fields go in fields.
+     */
+    void header_block(const RawFrame& frame, std::string_view fragment,
+            google::protobuf::RepeatedPtrField<h2proto::HeaderField> *fields,
+            bool end_headers, bool first);
+    void flush_header_block();
+
+    void run_tests();
+
+    HPackDecompressor hpack;
+    std::vector<DecodeError> errors;
+
+    /* Offset of the next decode() input from the start of the stream */
+    size_t position = 0;
+    bool expect_preface = true;
+
+    /* Header block still waiting for END_HEADERS */
+    struct BlockFragment {
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> *fields;
+        size_t end;
+    };
+    std::pmr::string block;
+    std::vector<BlockFragment> block_fragments;
+    RawFrame block_frame;
+    bool block_open = false;
+};
+
+/* Decode a complete capture. Returns true if it decoded without errors. */
+bool DecodeSequence(std::string_view buf, h2proto::Sequence *seq,
+        std::vector<DecodeError> *errors = nullptr);
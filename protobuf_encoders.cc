@@ -1,3 +1,4 @@
+#include <cassert>
 #include <string>
 #include <algorithm>
 
@@ -6,36 +7,114 @@
 
 #include "protobuf_encoders.h"
 #include "hpack_compressor.h"
+#include "encoding_context.h"
+#include "frame_dispatch.h"
+#include "huffman.h"
+#include "byte_order.h"
+#include "encoder_telemetry.h"
+#include "encoder_features.h"
+
+/* Control frames with a fixed payload size.
+ * The header is assembled with two big-endian stores (length + type, then
+ * stream ID) straight into space reserved in the sink; put() returns the
+ * payload for the caller to fill in the same way.
+ */
+template <uint8_t Type, uint32_t Length>
+struct FixedFrame {
+    static_assert(Length < (1 << 24));
+    static constexpr size_t size = H2_FRAME_HEADER_SIZE + Length;
+    static constexpr uint32_t length_type = Length << 8 | Type;
+
+    static char *put(EncodeBuffer& out, uint8_t flags, uint32_t stream_id) {
+        size_t start = out.size();
+        out.resize(start + size);
+
+        char *header = &out[start];
+        store_be32(header, length_type);
+        header[4] = flags;
+        store_be32(header + 5, std::min(stream_id, MAX_INT_31));
+
+        return header + H2_FRAME_HEADER_SIZE;
+    }
+};
+
+template <typename T>
+static uint32_t pad_length(const T& frame)
+{
+    return frame.has_pad_length() ? std::min(frame.pad_length(), (uint32_t)255) : 0;
+}
+
+/* Conversation: one connection, preface first */
+DECLARE_ENCODE_FUNCTION(h2proto::Conversation, conversation)
+{
+    for (const auto& exchange : conversation.exchanges())
+        EncodeTo(exchange, out, ctx);
+}
+
+
+/* Exchange: only the request side goes on the wire. The response side
+ * becomes a ResponseMatcher on ctx, and any SETTINGS and WINDOW_UPDATEs in it
+ * are applied so later exchanges respect the peer's limits and windows.
+ */
+DECLARE_ENCODE_FUNCTION(h2proto::Exchange, exchange)
+{
+    ctx.write_preface(out);
+
+    EncodeTo(exchange.request_sequence(), out, ctx);
+
+    const h2proto::Sequence& response = exchange.response_sequence();
+    for (const auto& frame : response.frames()) {
+        if (frame.has_settings_frame())
+            ctx.apply_peer_settings(frame.settings_frame());
+        else if (frame.has_window_update_frame())
+            ctx.flow.peer_window_update(frame.window_update_frame().window_size_increment());
+    }
+
+    ctx.pending_responses.emplace_back(response);
+}
+
 
 /* Frame Sequence */
 DECLARE_ENCODE_FUNCTION(h2proto::Sequence, sequence)
 {
-    std::string buf;// = Encode(sequence.settings_frame());
-    for (auto frame : sequence.frames()) buf += Encode(frame);
+    for (const auto& frame : sequence.frames()) EncodeTo(frame, out, ctx);
+}
 
-    return buf;
+
+/* Streaming Frame Sequence */
+Generator<EncodeBuffer> EncodeFrames(const h2proto::Sequence& seq,
+        EncodingContext& ctx, size_t batch_bytes)
+{
+    EncodeBuffer buf(ctx.memory);
+    for (const auto& frame : seq.frames()) {
+        EncodeTo(frame, buf, ctx);
+
+        // Frames with nothing set encode to nothing; don't yield for them
+        if (!buf.empty() && buf.size() >= batch_bytes) {
+            co_yield std::move(buf);
+            buf = EncodeBuffer(ctx.memory);
+        }
+    }
+
+    if (!buf.empty())
+        co_yield std::move(buf);
 }
 
 
 /* Frame Wrapper */
 DECLARE_ENCODE_FUNCTION(h2proto::Frame, frame)
 {
-    // Pls compile 2 jump table
-    using enum h2proto::Frame::FrameOneofCase;
-    switch (frame.frame_oneof_case()) {
-        case kDataFrame: return Encode(frame.data_frame());
-        case kHeadersFrame: return Encode(frame.headers_frame());
-        case kPriorityFrame: return Encode(frame.priority_frame());
-        case kRstStreamFrame: return Encode(frame.rst_stream_frame());
-        case kSettingsFrame: return Encode(frame.settings_frame());
-        case kPushPromiseFrame: return Encode(frame.push_promise_frame());
-        case kPingFrame: return Encode(frame.ping_frame());
-        case kGoawayFrame: return Encode(frame.goaway_frame());
-        case kWindowUpdateFrame: return Encode(frame.window_update_frame());
-        case kContinuationFrame: return Encode(frame.continuation_frame());
-    }
+    TELEMETRY(uint64_t t0 = telemetry_clock(); size_t n0 = out.size());
+
+    // Stream state tracking may move the frame to another stream
+    const h2proto::Frame& sent = ctx.streams.apply(frame);
+    ctx.priorities.update(sent);
+    FEATURE(feature_frame(ctx.features, sent.frame_oneof_case()));
 
-    return std::string();
+    VisitFrame(sent, [&](const auto& f) { EncodeTo(f, out, ctx); });
+
+    TELEMETRY(telemetry_frame(frame.frame_oneof_case(), out.size() - n0,
+            telemetry_clock() - t0));
 }
 
 
@@ -44,112 +123,96 @@ DECLARE_ENCODE_FUNCTION(h2proto::Frame, frame)
  */
 DECLARE_ENCODE_FUNCTION(h2proto::HPackInt, integer)
 {
-    std::string buf;
-
-    uint8_t msb_mask = std::min(integer.msb_mask(), (uint32_t)255);
-    int prefix = std::max(integer.prefix(), (uint32_t)8);
-    uint8_t max = (1 << prefix) - 1;
-
-    if (integer.value() < max) {
-        buf += integer.value() | msb_mask;
-        return buf;
-    }
-
-    uint64_t running = integer.value();
-    running -= max;
-    buf += max | msb_mask;
-
-    while (running >= 128) {
-        buf += (running % 128 + 128);
-        running /= 128;
-    }
-
-    buf += running;
-    return buf;
+    append_hpack_int(out, integer.value(), integer.prefix(),
+            std::min(integer.msb_mask(), (uint32_t)255));
 }
 
 
 /* HPack Strings. */
 DECLARE_ENCODE_FUNCTION(h2proto::HPackString, str)
 {
-#include "huffman.h"
-
-    std::string buf;
-
-    // With Huffman coding
-    if (str.huffman()) {
-        int octet_offset = 0;
-        for (auto c : str.data())
-        {
-            HuffmanCode code = huffman_table[c];
-
-            for (int i = 0; i < code.bit_len; i += 8)
-            {
-                int remaining_bits = 0;
-                uint8_t dat;
-
-                if (code.bit_len > i + 8) {
-                    dat = (code.code >> (code.bit_len - 8 - i));
-                } else {
-                    dat = code.code;
-                    remaining_bits = (32 - code.bit_len) % 8;
-                }
-
-                if (octet_offset == 0) {
-                    buf += dat << remaining_bits;
-                } else {
-                    if (code.bit_len > octet_offset) {
-                        uint32_t shift = std::min(code.bit_len, (uint32_t)8) -
-                                octet_offset;
-
-                        buf.back() |= dat >> shift;
-
-                        // There are still bits to write
-
-                        // If we are carrying over from another byte
-                        if (i > 0)
-                            dat &= (2 << (8 - shift)) - 1;
-
-                        buf += dat << (8 - shift);
-                    }
-                    else
-                        buf.back() |= dat << (octet_offset - code.bit_len);
-                }
-
-                // Recalculate offset
-                octet_offset += remaining_bits;
-                octet_offset %= 8;
-            }
-        }
+    const std::string& data = str.data();
+
+    // Without huffman coding
+    if (!str.huffman()) {
+        append_hpack_int(out, data.size(), 7, 0);
+        out += data;
+        TELEMETRY(telemetry_string(false, data.size()));
+        return;
+    }
 
-        // EOS padding
-        if (octet_offset) {
-            buf.back() |= 0xff >> (8 - octet_offset);
+    // With Huffman coding, the coded length is needed up front
+    uint64_t bit_len = 0;
+    for (uint8_t c : data) bit_len += huffman_table[c].bit_len;
+    append_hpack_int(out, (bit_len + 7) / 8, 7, 1 << 7);
+    TELEMETRY(telemetry_string(true, (bit_len + 7) / 8));
+    FEATURE(feature_huffman_string(bit_len));
+
+    // Codes are at most 30 bits, so 7 pending bits + 1 code fit in 64
+    uint64_t pending = 0;
+    int pending_bits = 0;
+    for (uint8_t c : data) {
+        const HuffmanCode& code = huffman_table[c];
+        pending = (pending << code.bit_len) | code.code;
+        pending_bits += code.bit_len;
+
+        while (pending_bits >= 8) {
+            pending_bits -= 8;
+            out += (char)(pending >> pending_bits);
         }
     }
-    else {
-        // Without huffman coding
-        buf += str.data();
-    }
-
-    h2proto::HPackInt length;
-    length.set_value(buf.size());
-    length.set_prefix(7);
-    length.set_msb_mask(str.huffman() << 7);
-    buf.insert(0, Encode(length));
 
-    return buf;
+    // EOS padding
+    if (pending_bits) {
+        out += (char)((pending << (8 - pending_bits)) | (0xff >> pending_bits));
+    }
 }
 
 
 /* Frame Type 0: DATA */
-DECLARE_ENCODE_FUNCTION(h2proto::DataFrame, frame)
+DECLARE_ENCODE_FUNCTION(h2proto::DataFrame, data_frame)
 {
-    std::string buf = frame.data();
-    uint8_t flags = frame.end_stream() << 0;
+    // Flow control may resize the payload to the window
+    const h2proto::DataFrame& frame = ctx.flow.apply(data_frame);
+    const std::string& data = frame.data();
+    uint32_t limit = ctx.frame_size_limit();
+    uint32_t pad_overhead = frame.has_pad_length() ? 1 + pad_length(frame) : 0;
+
+    if (!ctx.framing.fragment || data.size() + pad_overhead <= limit) {
+        size_t start = enframe_begin(out);
+        uint8_t flags = frame.end_stream() << 0;
+
+        PAD_H2_FRAME_BEGIN(frame, out, flags);
+        out += data;
+        PAD_H2_FRAME_END(frame, out);
+
+        enframe_end(out, start, 0, flags, frame.stream_id());
+        return;
+    }
 
-    PAD_H2_FRAME(frame, buf, flags);
-    return enframe(0, flags, frame.stream_id(), buf);
+    // Chunk the body; padding and END_STREAM go on the last chunk only
+    size_t offset = 0;
+    for (;;) {
+        size_t remaining = data.size() - offset;
+        bool last = remaining + pad_overhead <= limit || remaining == 0;
+
+        size_t start = enframe_begin(out);
+        uint8_t flags = 0;
+
+        if (last) {
+            flags |= frame.end_stream() << 0;
+            PAD_H2_FRAME_BEGIN(frame, out, flags);
+            out.append(data, offset, remaining);
+            PAD_H2_FRAME_END(frame, out);
+        } else {
+            size_t chunk = std::min(remaining, (size_t)limit);
+            out.append(data, offset, chunk);
+            offset += chunk;
+        }
+
+        enframe_end(out, start, 0, flags, frame.stream_id());
+        if (last) break;
+    }
 }
 
 
@@ -157,158 +220,224 @@ DECLARE_ENCODE_FUNCTION(h2proto::DataFrame, frame)
 
 DECLARE_ENCODE_FUNCTION(h2proto::HeadersFrame, frame)
 {
-    std::string buf;
-    uint8_t flags = 0;
+    size_t start = enframe_begin(out);
+    uint8_t flags = frame.end_stream() << 0;
 
-    // Stream dependency
-    if (frame.has_stream_dependency()) {
-        std::string packed = pack_int(frame.stream_dependency(), 4);
-        buf += (frame.exclusive() << 7) | (packed[0] & ~(1 << 7));
-        buf += packed.substr(1);
+    PAD_H2_FRAME_BEGIN(frame, out, flags);
+
+    // Stream dependency + weight
+    if (frame.priority()) {
+        append_int(out, ((uint32_t)frame.exclusive() << 31) |
+                (frame.stream_dependency() & MAX_INT_31), 4);
+        out += (char)std::min(frame.weight(), (uint32_t)255);
         flags |= 0x20;
     }
 
-    buf += hpack_compressor.compress(frame.header_list());
-
-    PAD_H2_FRAME(frame, buf, flags);
+    size_t block_start = out.size();
+    ctx.hpack.compress(frame.header_list(), out);
 
-    return enframe(1, flags, frame.stream_id(), buf);
+    enframe_header_block(out, start, block_start, 1, flags, frame.stream_id(),
+            frame.end_headers(), pad_length(frame), ctx);
 }
 
 
 /* Frame Type 2: PRIORITY */
 DECLARE_ENCODE_FUNCTION(h2proto::PriorityFrame, frame)
 {
-    std::string buf, packed = pack_int(frame.stream_dependency(), 4);
-    buf += (frame.exclusive() << 7) | (packed[0] & ~(1 << 7));
-    buf += packed.substr(1);
-    buf += std::min(frame.weight(), (uint32_t)255);
+    char *payload = FixedFrame<2, 5>::put(out, 0, frame.stream_id());
 
-    return enframe(2, 0, 0, buf);
+    store_be32(payload, ((uint32_t)frame.exclusive() << 31) |
+            (frame.stream_dependency() & MAX_INT_31));
+    payload[4] = std::min(frame.weight(), (uint32_t)255);
 }
 
 
 /* Frame Type 3: RST_STREAM */
 DECLARE_ENCODE_FUNCTION(h2proto::RstStreamFrame, frame)
 {
-    return enframe(3, 0, 0, pack_int(frame.error_code(), 4));
+    char *payload = FixedFrame<3, 4>::put(out, 0, frame.stream_id());
+    store_be32(payload, frame.error_code());
 }
 
 
 /* Frame Type 4: SETTINGS */
 DECLARE_ENCODE_FUNCTION(h2proto::SettingsFrame, frame)
 {
-    std::string buf;
-    uint8_t flags = frame.ack();
+    if (frame.ack()) {
+        FixedFrame<4, 0>::put(out, 0x1, 0);
+        return;
+    }
 
-    // Params
-    if (!frame.ack())
-    {
-        std::vector<std::pair<uint32_t, uint32_t>> parameters;
-        if (frame.has_header_table_size())
-            parameters.push_back({ 1, frame.header_table_size() });
+    size_t start = enframe_begin(out);
 
-        if (frame.has_enable_push())
-            parameters.push_back({ 2, frame.enable_push() });
+    // Params
+    auto param = [&](uint16_t id, uint32_t value) {
+        append_int(out, id, 2);
+        append_int(out, value, 4);
+    };
+
+    if (frame.has_header_table_size()) {
+        param(1, frame.header_table_size());
+        FEATURE(feature_table_size(ctx.features, frame.header_table_size()));
+    }
 
-        if (frame.has_max_concurrent_streams())
-            parameters.push_back({ 3, frame.max_concurrent_streams() });
+    if (frame.has_enable_push())
+        param(2, frame.enable_push());
 
-        if (frame.has_initial_window_size())
-            parameters.push_back({ 4, frame.initial_window_size() });
+    if (frame.has_max_concurrent_streams())
+        param(3, frame.max_concurrent_streams());
 
-        if (frame.has_max_frame_size())
-            parameters.push_back({ 5, frame.max_frame_size() });
+    if (frame.has_initial_window_size())
+        param(4, frame.initial_window_size());
 
-        if (frame.has_max_header_list_size())
-            parameters.push_back({ 6, frame.max_header_list_size() });
+    if (frame.has_max_frame_size())
+        param(5, frame.max_frame_size());
 
-        for (auto param : parameters) {
-            buf += pack_int(std::get<0>(param), 2);
-            buf += pack_int(std::get<1>(param), 4);
-        }
-    }
+    if (frame.has_max_header_list_size())
+        param(6, frame.max_header_list_size());
 
-    return enframe(4, flags, 0, buf);
+    enframe_end(out, start, 4, 0, 0);
 }
 
 
 /* Frame Type 5: PUSH_PROMISE */
 DECLARE_ENCODE_FUNCTION(h2proto::PushPromiseFrame, frame)
 {
-    std::string buf;
-    uint8_t flags = frame.end_headers() << 2;
+    size_t start = enframe_begin(out);
+    uint8_t flags = 0;
+
+    PAD_H2_FRAME_BEGIN(frame, out, flags);
 
-    buf += pack_int(std::min(frame.promised_stream_id(), MAX_INT_31), 4);
-    buf += hpack_compressor.compress(frame.header_list());
+    append_int(out, std::min(frame.promised_stream_id(), MAX_INT_31), 4);
 
-    PAD_H2_FRAME(frame, buf, flags);
+    size_t block_start = out.size();
+    ctx.hpack.compress(frame.header_list(), out);
 
-    return enframe(5, flags, frame.stream_id(), buf);
+    enframe_header_block(out, start, block_start, 5, flags, frame.stream_id(),
+            frame.end_headers(), pad_length(frame), ctx);
 }
 
 
 /* Frame Type 6: PING */
 DECLARE_ENCODE_FUNCTION(h2proto::PingFrame, frame)
 {
-    std::string buf;
-    uint8_t flags = frame.ack();
-
-    buf += pack_int(frame.opaque_data_lo(), 4);
-    buf += pack_int(frame.opaque_data_hi(), 4);
+    char *payload = FixedFrame<6, 8>::put(out, frame.ack(), 0);
 
-    return enframe(6, flags, 0, buf);
+    store_be32(payload, frame.opaque_data_lo());
+    store_be32(payload + 4, frame.opaque_data_hi());
 }
 
 
 /* Frame Type 7: GOAWAY */
 DECLARE_ENCODE_FUNCTION(h2proto::GoawayFrame, frame)
 {
-    std::string buf;
+    size_t start = enframe_begin(out);
+
+    append_int(out, std::min(frame.last_stream_id(), MAX_INT_31), 4);
+    append_int(out, frame.error_code(), 4);
 
-    buf += pack_int(std::min(frame.last_stream_id(), MAX_INT_31), 4);
-    buf += pack_int(frame.error_code(), 4);
-    
     if (frame.has_opaque_data()) {
-        buf += frame.opaque_data();
+        out += frame.opaque_data();
     }
 
-    return enframe(7, 0, 0, buf);
+    enframe_end(out, start, 7, 0, 0);
 }
 
 
 /* Frame Type 8: WINDOW_UPDATE */
-DECLARE_ENCODE_FUNCTION(h2proto::WindowUpdateFrame, frame)
+DECLARE_ENCODE_FUNCTION(h2proto::WindowUpdateFrame, update)
 {
-    std::string buf;
-
-    buf += pack_int(std::min(frame.window_size_increment(), MAX_INT_31), 4);
-
-    return enframe(8, 0, 0, buf);
+    const h2proto::WindowUpdateFrame& frame = ctx.flow.apply(update);
+    char *payload = FixedFrame<8, 4>::put(out, 0, 0);
+    store_be32(payload, std::min(frame.window_size_increment(), MAX_INT_31));
 }
 
 
 /* Frame Type 9: CONTINUATION */
 DECLARE_ENCODE_FUNCTION(h2proto::ContinuationFrame, frame)
 {
-    std::string buf;
-    uint8_t flags = frame.end_headers() << 2;
+    size_t start = enframe_begin(out);
+    size_t block_start = out.size();
 
-    buf += hpack_compressor.compress(frame.header_list());
+    ctx.hpack.compress(frame.header_list(), out);
 
-    return enframe(9, flags, frame.stream_id(), buf);
+    enframe_header_block(out, start, block_start, 9, 0, frame.stream_id(),
+            frame.end_headers(), 0, ctx);
 }
 
 /* Helpers */
 std::string enframe(uint8_t type, uint8_t flags, uint32_t stream_id, std::string payload)
 {
-    std::string header;
-    header += pack_int(payload.size(), 3);
-    header += type;
-    header += flags;
-    header += pack_int(std::min(stream_id, MAX_INT_31), 4);
+    EncodeBuffer buf;
+    size_t start = enframe_begin(buf);
+    buf += payload;
+    enframe_end(buf, start, type, flags, stream_id);
+
+    return std::string(buf);
+}
+
+/* Finish a frame whose header block starts at block_start and runs to the end
+ * of out, then add `padding` bytes. Whatever does not fit in the peer's max
+ * frame size is moved into CONTINUATION frames, and END_HEADERS is set on
+ * the last of them only.
+ */
+void enframe_header_block(EncodeBuffer& out, size_t start, size_t block_start,
+        uint8_t type, uint8_t flags, uint32_t stream_id, bool end_headers,
+        uint32_t padding, EncodingContext& ctx)
+{
+    uint32_t limit = ctx.frame_size_limit();
+    size_t payload = out.size() - start - H2_FRAME_HEADER_SIZE + padding;
+
+    if (!ctx.framing.fragment || payload <= limit) {
+        out.append(padding, '\0');
+        enframe_end(out, start, type, flags | (end_headers << 2), stream_id);
+        return;
+    }
+
+    // Pad Length, priority/promised ID and padding stay in the first frame
+    size_t fixed = block_start - start - H2_FRAME_HEADER_SIZE + padding;
+    size_t first = limit > fixed ? limit - fixed : 0;
+
+    EncodeBuffer rest(out, block_start + first, ctx.memory);
+    out.resize(block_start + first);
+    out.append(padding, '\0');
+    enframe_end(out, start, type, flags, stream_id);
+
+    for (size_t offset = 0; offset < rest.size(); offset += limit) {
+        bool last = offset + limit >= rest.size();
+
+        size_t cont = enframe_begin(out);
+        out.append(rest, offset, limit);
+        enframe_end(out, cont, 9, (last && end_headers) << 2, stream_id);
+    }
+}
+
+/* Reserve room for a frame header; returns the offset of the frame */
+size_t enframe_begin(EncodeBuffer& out)
+{
+    size_t start = out.size();
+    out.append(H2_FRAME_HEADER_SIZE, '\0');
+
+    return start;
+}
 
-    return header + payload;
+/* Fill in the header reserved by enframe_begin once the payload is written */
+void enframe_end(EncodeBuffer& out, size_t start, uint8_t type, uint8_t flags,
+        uint32_t stream_id)
+{
+    uint32_t length = out.size() - start - H2_FRAME_HEADER_SIZE;
+    stream_id = std::min(stream_id, MAX_INT_31);
+
+    char *header = &out[start];
+    header[0] = length >> 16;
+    header[1] = length >> 8;
+    header[2] = length;
+    header[3] = type;
+    header[4] = flags;
+    header[5] = stream_id >> 24;
+    header[6] = stream_id >> 16;
+    header[7] = stream_id >> 8;
+    header[8] = stream_id;
 }
 
 std::string pack_int(uint32_t value, unsigned int nbytes)
@@ -320,3 +449,101 @@ std::string pack_int(uint32_t value, unsigned int nbytes)
 
     return buf;
 }
+
+void append_int(EncodeBuffer& out, uint32_t value, unsigned int nbytes)
+{
+    for (int i = nbytes - 1; i >= 0; i--) {
+        out += (value >> (i * 8)) & 0xff;
+    }
+}
+
+void append_hpack_int(EncodeBuffer& out, uint64_t value, uint32_t prefix,
+        uint8_t msb_mask)
+{
+    // RFC 7541 5.1: prefixes are 1 to 8 bits
+    prefix = std::clamp(prefix, (uint32_t)1, (uint32_t)8);
+    uint8_t max = (1 << prefix) - 1;
+
+    if (value < max) {
+        out += value | msb_mask;
+        return;
+    }
+
+    value -= max;
+    out += max | msb_mask;
+
+    while (value >= 128) {
+        out += (value % 128 + 128);
+        value /= 128;
+    }
+
+    out += value;
+}
+
+
+void RunEncodeFramesTests()
+{
+    // HEADERS that build on each other's HPACK state, a PING and a frame
+    // with nothing set
+    h2proto::Sequence seq;
+    for (int i = 0; i < 4; i++) {
+        h2proto::HeadersFrame *headers = seq.add_frames()->mutable_headers_frame();
+        headers->set_stream_id(2 * i + 1);
+        headers->set_end_stream(true);
+        headers->set_end_headers(true);
+
+        h2proto::HeaderField *field = headers->add_header_list();
+        field->mutable_name()->set_data("x-field-" + std::to_string(i % 2));
+        field->mutable_value()->set_data(std::string(10 * i, 'v'));
+        field->set_indexing(h2proto::HeaderField_Indexing_INCREMENTAL);
+
+        if (i == 1)
+            seq.add_frames()->mutable_ping_frame()->set_ack(false);
+        if (i == 2)
+            seq.add_frames();
+    }
+
+    // The batches add up to the whole sequence, none are empty, and all
+    // come from ctx.memory
+    for (size_t batch_bytes : { 0, 1, 40, 1 << 20 }) {
+        EncodingContext expected_ctx;
+        EncodeBuffer expected;
+        EncodeTo(seq, expected, expected_ctx);
+
+        std::pmr::monotonic_buffer_resource memory;
+        EncodingContext ctx(&memory);
+        EncodeBuffer joined;
+        for (EncodeBuffer& batch : EncodeFrames(seq, ctx, batch_bytes)) {
+            assert(!batch.empty());
+            assert(batch.get_allocator().resource() == &memory);
+            joined += batch;
+        }
+
+        assert(joined == expected);
+    }
+
+    // Dropping the generator early leaves ctx just past the last frame
+    // consumed: the rest then encodes as if sent after exactly those frames
+    for (int consumed = 1; consumed <= 3; consumed++) {
+        EncodingContext ctx;
+        {
+            Generator<EncodeBuffer> frames = EncodeFrames(seq, ctx);
+            auto it = frames.begin();
+            for (int i = 1; i < consumed; i++)
+                ++it;
+        }
+
+        EncodingContext expected_ctx;
+        EncodeBuffer sent;
+        for (int i = 0; i < consumed; i++)
+            EncodeTo(seq.frames(i), sent, expected_ctx);
+
+        EncodeBuffer rest, expected;
+        for (int i = consumed; i < seq.frames_size(); i++) {
+            EncodeTo(seq.frames(i), rest, ctx);
+            EncodeTo(seq.frames(i), expected, expected_ctx);
+        }
+
+        assert(rest == expected);
+    }
+}
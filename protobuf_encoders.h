@@ -1,29 +1,87 @@
 #pragma once
 #include <string>
 #include <algorithm>
+#include <memory_resource>
 
+#include "generator.h"
+
+struct EncodingContext;
+extern EncodingContext default_encoding_context;
+
+/* Output of the encoders. Allocates from whatever memory resource it was
+ * constructed with, normally ctx.memory.
+ */
+typedef std::pmr::string EncodeBuffer;
+
+/* Encoders are explicit specializations of EncodeTo, which appends to out
+ * rather than building a string of its own. Stateful encoders (HPACK) keep
+ * their state in ctx, so each connection needs its own context.
+ */
 template <typename T>
-std::string Encode(const T& t) {
-    Encode(t);
+void EncodeTo(const T& t, EncodeBuffer& out,
+        EncodingContext& ctx = default_encoding_context);
+
+/* Convenience wrapper returning a heap string. Hot loops should call
+ * EncodeTo with a buffer on ctx.memory instead and skip the copy.
+ */
+template <typename T>
+std::string Encode(const T& t, EncodingContext& ctx = default_encoding_context)
+{
+    EncodeBuffer buf;
+    EncodeTo(t, buf, ctx);
+    return std::string(buf);
 }
 
 #define DECLARE_ENCODE_FUNCTION(TYPE, NAME) \
     template<> \
-    std::string Encode<TYPE>(const TYPE& NAME)
+    void EncodeTo<TYPE>(const TYPE& NAME, EncodeBuffer& out, \
+            [[maybe_unused]] EncodingContext& ctx)
 
-#define PAD_H2_FRAME(FRAME, BUF, FLAGS) \
+/* Pad Length goes first in the payload, the padding itself last */
+#define PAD_H2_FRAME_BEGIN(FRAME, BUF, FLAGS) \
     if (FRAME.has_pad_length()) { \
-        BUF.insert(0, 1, std::min(FRAME.pad_length(), (uint32_t)255)); \
-        for (int i = 0; i < std::min(FRAME.pad_length(), (uint32_t)255); i++, BUF += (uint8_t)0); \
+        BUF += (char)std::min(FRAME.pad_length(), (uint32_t)255); \
         FLAGS |= 0x8; \
     }
 
+#define PAD_H2_FRAME_END(FRAME, BUF) \
+    if (FRAME.has_pad_length()) { \
+        BUF.append(std::min(FRAME.pad_length(), (uint32_t)255), '\0'); \
+    }
+
 #define MAX_INT_31 ((uint32_t)0x7fffffff)
 
+#define H2_FRAME_HEADER_SIZE 9
+
 // Prototypes
 std::string enframe(uint8_t type, uint8_t flags, uint32_t stream_id, std::string payload);
 std::string pack_int(uint32_t value, unsigned int nbytes);
 
+size_t enframe_begin(EncodeBuffer& out);
+void enframe_end(EncodeBuffer& out, size_t start, uint8_t type, uint8_t flags,
+        uint32_t stream_id);
+void enframe_header_block(EncodeBuffer& out, size_t start, size_t block_start,
+        uint8_t type, uint8_t flags, uint32_t stream_id, bool end_headers,
+        uint32_t padding, EncodingContext& ctx);
+void append_int(EncodeBuffer& out, uint32_t value, unsigned int nbytes);
+void append_hpack_int(EncodeBuffer& out, uint64_t value, uint32_t prefix,
+        uint8_t msb_mask);
+
+/* Lazily encode a sequence one frame at a time.
+ * Each resumption encodes the next frame(s) against ctx, so HPACK state is
+ * only advanced for frames that were actually consumed. With batch_bytes set,
+ * frames are accumulated until at least that many bytes are ready. Frames
+ * that encode to nothing go with the next batch, so none is empty. Buffers
+ * are allocated from ctx.memory.
+ * seq and ctx must outlive the generator.
+ */
+Generator<EncodeBuffer> EncodeFrames(const h2proto::Sequence& seq,
+        EncodingContext& ctx, size_t batch_bytes = 0);
+
+void RunEncodeFramesTests();
+
+DECLARE_ENCODE_FUNCTION(h2proto::Conversation, conversation);
+DECLARE_ENCODE_FUNCTION(h2proto::Exchange, exchange);
 DECLARE_ENCODE_FUNCTION(h2proto::Sequence, sequence);
 DECLARE_ENCODE_FUNCTION(h2proto::Frame, frame);
 DECLARE_ENCODE_FUNCTION(h2proto::DataFrame, frame);
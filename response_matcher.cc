@@ -0,0 +1,105 @@
+#include <string_view>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+#include "response_matcher.h"
+#include "frame_dispatch.h"
+
+/* Flags worth waiting for, by oneof case */
+static constexpr uint8_t matched_flags[] = {
+    [h2proto::Frame::FRAME_ONEOF_NOT_SET]   = 0,
+    [h2proto::Frame::kDataFrame]            = 0x1,  // END_STREAM
+    [h2proto::Frame::kHeadersFrame]         = 0x1,  // END_STREAM
+    [h2proto::Frame::kPriorityFrame]        = 0,
+    [h2proto::Frame::kRstStreamFrame]       = 0,
+    [h2proto::Frame::kSettingsFrame]        = 0x1,  // ACK
+    [h2proto::Frame::kPushPromiseFrame]     = 0,
+    [h2proto::Frame::kPingFrame]            = 0x1,  // ACK
+    [h2proto::Frame::kGoawayFrame]          = 0,
+    [h2proto::Frame::kWindowUpdateFrame]    = 0,
+    [h2proto::Frame::kContinuationFrame]    = 0
+};
+
+struct ExpectationBuilder {
+    uint8_t type;
+
+    FrameExpectation operator()(const h2proto::DataFrame& f) {
+        return { type, (uint8_t)f.end_stream(), f.stream_id() };
+    }
+    FrameExpectation operator()(const h2proto::HeadersFrame& f) {
+        return { type, (uint8_t)f.end_stream(), f.stream_id() };
+    }
+    FrameExpectation operator()(const h2proto::PriorityFrame& f) {
+        return { type, 0, f.stream_id() };
+    }
+    FrameExpectation operator()(const h2proto::RstStreamFrame& f) {
+        return { type, 0, f.stream_id() };
+    }
+    FrameExpectation operator()(const h2proto::SettingsFrame& f) {
+        return { type, (uint8_t)f.ack(), 0 };
+    }
+    FrameExpectation operator()(const h2proto::PushPromiseFrame& f) {
+        return { type, 0, f.stream_id() };
+    }
+    FrameExpectation operator()(const h2proto::PingFrame& f) {
+        return { type, (uint8_t)f.ack(), 0 };
+    }
+    FrameExpectation operator()(const h2proto::GoawayFrame&) {
+        return { type, 0, 0 };
+    }
+    FrameExpectation operator()(const h2proto::WindowUpdateFrame&) {
+        return { type, 0, 0 };
+    }
+    FrameExpectation operator()(const h2proto::ContinuationFrame& f) {
+        return { type, 0, f.stream_id() };
+    }
+};
+
+ResponseMatcher::ResponseMatcher(const h2proto::Sequence& response)
+{
+    expected.reserve(response.frames_size());
+    for (const auto& frame : response.frames()) {
+        if (frame.frame_oneof_case() == h2proto::Frame::FRAME_ONEOF_NOT_SET)
+            continue;
+
+        uint8_t type = frame_type_ids[frame.frame_oneof_case()];
+        expected.push_back(VisitFrame(frame, ExpectationBuilder{type}));
+    }
+}
+
+bool ResponseMatcher::feed(uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+    if (done())
+        return false;
+
+    const FrameExpectation& next = expected[matched];
+    if (type != next.type || stream_id != next.stream_id)
+        return false;
+
+    uint8_t mask = type < num_frame_types ? matched_flags[frame_oneof_cases[type]] : 0;
+    if ((flags & mask) != (next.flags & mask))
+        return false;
+
+    matched++;
+    return true;
+}
+
+size_t ResponseMatcher::feed(std::string_view buf)
+{
+    size_t offset = 0;
+    while (buf.size() - offset >= 9) {
+        const uint8_t *header = (const uint8_t *)buf.data() + offset;
+        uint32_t length = header[0] << 16 | header[1] << 8 | header[2];
+
+        if (buf.size() - offset - 9 < length)
+            break;
+
+        uint32_t stream_id = (header[5] << 24 | header[6] << 16 |
+                header[7] << 8 | header[8]) & 0x7fffffff;
+        feed(header[3], header[4], stream_id);
+
+        offset += 9 + length;
+    }
+
+    return offset;
+}
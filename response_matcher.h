@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/* A frame we expect the peer to send */
+struct FrameExpectation {
+    uint8_t type;
+    uint8_t flags;      // Only END_STREAM / ACK are compared
+    uint32_t stream_id;
+};
+
+/* Paces an exchange against the peer.
+ * Built from an Exchange's response_sequence; the driver feeds it whatever
+ * the peer sends and moves on to the next exchange once done(). Expected
+ * frames are matched in order, and anything unexpected in between (window
+ * updates, extra settings, ...) is skipped.
+ */
+struct ResponseMatcher {
+    ResponseMatcher() {}
+    ResponseMatcher(const h2proto::Sequence& response);
+
+    /* Returns true if the frame matched the next expectation */
+    bool feed(uint8_t type, uint8_t flags, uint32_t stream_id);
+
+    /* Feed every complete frame in buf; returns the number of bytes used */
+    size_t feed(std::string_view buf);
+
+    bool done() const { return matched == expected.size(); }
+
+    std::vector<FrameExpectation> expected;
+    size_t matched = 0;
+};
@@ -0,0 +1,276 @@
+#include <string>
+#include <algorithm>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "roundtrip_check.h"
+#include "protobuf_encoders.h"
+#include "protobuf_decoders.h"
+#include "encoding_context.h"
+#include "frame_dispatch.h"
+#include "stage_timers.h"
+
+typedef google::protobuf::RepeatedPtrField<h2proto::HeaderField> HeaderList;
+
+static uint32_t clamp_stream_id(uint32_t stream_id)
+{
+    return std::min(stream_id, MAX_INT_31);
+}
+
+template <typename T>
+static void canonical_pad_length(T& frame)
+{
+    if (frame.has_pad_length())
+        frame.set_pad_length(std::min(frame.pad_length(), (uint32_t)255));
+}
+
+static void canonical_header_list(HeaderList *fields)
+{
+    for (auto& field : *fields) {
+        field.mutable_name()->set_force_literal(false);
+        field.mutable_name()->set_huffman(false);
+        field.mutable_value()->set_force_literal(false);
+        field.mutable_value()->set_huffman(false);
+        field.set_indexing(h2proto::HeaderField_Indexing_WITHOUT_INDEX);
+    }
+}
+
+/* Reduce each frame to what the encoder puts on the wire */
+struct FrameCanonicalizer {
+    void operator()(h2proto::DataFrame& f) {
+        canonical_pad_length(f);
+        f.set_stream_id(clamp_stream_id(f.stream_id()));
+    }
+
+    void operator()(h2proto::HeadersFrame& f) {
+        canonical_pad_length(f);
+        if (f.priority()) {
+            f.set_stream_dependency(f.stream_dependency() & MAX_INT_31);
+            f.set_weight(std::min(f.weight(), (uint32_t)255));
+        } else {
+            f.set_exclusive(false);
+            f.set_stream_dependency(0);
+            f.set_weight(0);
+        }
+        f.set_stream_id(clamp_stream_id(f.stream_id()));
+        canonical_header_list(f.mutable_header_list());
+    }
+
+    void operator()(h2proto::PriorityFrame& f) {
+        f.set_stream_dependency(f.stream_dependency() & MAX_INT_31);
+        f.set_weight(std::min(f.weight(), (uint32_t)255));
+        f.set_stream_id(clamp_stream_id(f.stream_id()));
+    }
+
+    void operator()(h2proto::RstStreamFrame& f) {
+        f.set_stream_id(clamp_stream_id(f.stream_id()));
+    }
+
+    void operator()(h2proto::SettingsFrame& f) {
+        if (f.ack()) {
+            f.Clear();
+            f.set_ack(true);
+        }
+    }
+
+    void operator()(h2proto::PushPromiseFrame& f) {
+        canonical_pad_length(f);
+        f.set_promised_stream_id(clamp_stream_id(f.promised_stream_id()));
+        f.set_stream_id(clamp_stream_id(f.stream_id()));
+        canonical_header_list(f.mutable_header_list());
+    }
+
+    void operator()(h2proto::PingFrame&) {}
+
+    void operator()(h2proto::GoawayFrame& f) {
+        f.set_last_stream_id(clamp_stream_id(f.last_stream_id()));
+        if (f.has_opaque_data() && f.opaque_data().empty())
+            f.clear_opaque_data();
+    }
+
+    void operator()(h2proto::WindowUpdateFrame& f) {
+        f.set_window_size_increment(std::min(f.window_size_increment(), MAX_INT_31));
+    }
+
+    void operator()(h2proto::ContinuationFrame& f) {
+        f.set_stream_id(clamp_stream_id(f.stream_id()));
+        canonical_header_list(f.mutable_header_list());
+    }
+};
+
+/* Header block fields of HEADERS, PUSH_PROMISE and CONTINUATION */
+static HeaderList *header_list(h2proto::Frame *frame)
+{
+    return VisitFrame(frame, [](auto& f) -> HeaderList * {
+        if constexpr (requires { f.mutable_header_list(); })
+            return f.mutable_header_list();
+        return nullptr;
+    });
+}
+
+static bool end_headers(h2proto::Frame *frame)
+{
+    return VisitFrame(frame, [](auto& f) {
+        if constexpr (requires { f.end_headers(); })
+            return f.end_headers();
+        return true;
+    });
+}
+
+static void set_end_headers(h2proto::Frame *frame, bool value)
+{
+    VisitFrame(frame, [&](auto& f) {
+        if constexpr (requires { f.set_end_headers(value); })
+            f.set_end_headers(value);
+    });
+}
+
+/* Frames whose fields are kept are merged the same way the decoder puts a
+ * split header block back together: the block is opened by a frame without
+ * END_HEADERS and runs through the CONTINUATIONs that follow it.
+ */
+h2proto::Sequence CanonicalSequence(const h2proto::Sequence& seq)
+{
+    h2proto::Sequence out;
+    h2proto::Frame *block = nullptr;
+    h2proto::DataFrame *data = nullptr;
+
+    for (const auto& original : seq.frames()) {
+        if (original.frame_oneof_case() == h2proto::Frame::FRAME_ONEOF_NOT_SET)
+            continue;
+
+        h2proto::Frame frame = original;
+        VisitFrame(&frame, FrameCanonicalizer());
+
+        // Rest of an open header block
+        if (block && frame.has_continuation_frame()) {
+            h2proto::ContinuationFrame *cont = frame.mutable_continuation_frame();
+            HeaderList *fields = header_list(block);
+
+            for (auto& field : *cont->mutable_header_list())
+                fields->Add()->Swap(&field);
+
+            set_end_headers(block, cont->end_headers());
+            if (cont->end_headers())
+                block = nullptr;
+            continue;
+        }
+        block = nullptr;
+
+        // Rest of a DATA run that has not ended
+        if (data && frame.has_data_frame() &&
+                frame.data_frame().stream_id() == data->stream_id()) {
+            const h2proto::DataFrame& next = frame.data_frame();
+
+            data->mutable_data()->append(next.data());
+            data->set_end_stream(next.end_stream());
+            if (next.has_pad_length())
+                data->set_pad_length(next.pad_length());
+
+            if (data->has_pad_length() || data->end_stream())
+                data = nullptr;
+            continue;
+        }
+        data = nullptr;
+
+        h2proto::Frame *added = out.add_frames();
+        added->Swap(&frame);
+
+        if (header_list(added) && !end_headers(added))
+            block = added;
+
+        if (added->has_data_frame() && !added->data_frame().has_pad_length() &&
+                !added->data_frame().end_stream())
+            data = added->mutable_data_frame();
+    }
+
+    return out;
+}
+
+template <typename Table>
+static bool same_tables(const HPackCompressor::dynamic_header_list& encoder,
+        const Table& decoder)
+{
+    if (encoder.size() != decoder.size())
+        return false;
+
+    for (size_t i = 0; i < encoder.size(); i++) {
+        if (encoder[i].first != decoder[i].first ||
+                encoder[i].second != decoder[i].second)
+            return false;
+    }
+
+    return true;
+}
+
+static bool compare(const h2proto::Sequence& expected, std::string_view wire,
+        const EncodingContext& ctx, std::string *report)
+{
+    FrameDecoder decoder;
+    h2proto::Sequence decoded;
+
+    size_t used = decoder.decode(wire, &decoded);
+    decoder.finish(wire.substr(used));
+
+    h2proto::Sequence want = CanonicalSequence(expected);
+    h2proto::Sequence got = CanonicalSequence(decoded);
+
+    bool frames_match = want.SerializeAsString() == got.SerializeAsString();
+    bool tables_match = same_tables(ctx.hpack.dynamic_table, decoder.hpack.dynamic_table);
+
+    if (frames_match && tables_match)
+        return true;
+
+    if (report) {
+        report->clear();
+
+        if (!frames_match) {
+            google::protobuf::util::MessageDifferencer differencer;
+            differencer.ReportDifferencesToString(report);
+            differencer.Compare(want, got);
+        }
+
+        if (!tables_match) {
+            *report += "HPACK dynamic tables differ: encoder has " +
+                    std::to_string(ctx.hpack.dynamic_table.size()) +
+                    " entries, decoder " +
+                    std::to_string(decoder.hpack.dynamic_table.size()) + "\n";
+        }
+
+        for (const auto& error : decoder.errors) {
+            *report += std::string(decode_error_names[error.code]) + " at " +
+                    std::to_string(error.offset) + ": " + error.what + "\n";
+        }
+    }
+
+    return false;
+}
+
+bool CheckRoundTrip(const h2proto::Sequence& seq, std::string *report)
+{
+    STAGE_TIMER(FUZZ_STAGE_ROUNDTRIP_CHECK);
+
+    EncodingContext ctx;
+    EncodeBuffer wire(ctx.memory);
+    EncodeTo(seq, wire, ctx);
+    return compare(seq, wire, ctx, report);
+}
+
+bool CheckRoundTrip(const h2proto::Conversation& conversation,
+        std::string *report)
+{
+    STAGE_TIMER(FUZZ_STAGE_ROUNDTRIP_CHECK);
+
+    EncodingContext ctx;
+    EncodeBuffer wire(ctx.memory);
+    EncodeTo(conversation, wire, ctx);
+
+    h2proto::Sequence requests;
+    for (const auto& exchange : conversation.exchanges())
+        requests.MergeFrom(exchange.request_sequence());
+
+    return compare(requests, wire, ctx, report);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+/* Encoder self-check.
+ * Encodes the input on a fresh EncodingContext, decodes the bytes with
+ * FrameDecoder/HPackDecompressor and compares the result with the input
+ * after both are put in canonical form:
+ *
+ *  - values the encoder clamps (pad_length, weight, 31-bit stream IDs,
+ *    window increments) are clamped the same way
+ *  - fields that are not on the wire (priority fields without PRIORITY,
+ *    SETTINGS parameters on an ACK, empty GOAWAY opaque data) are cleared
+ *  - header blocks are merged into the frame that opens them and DATA runs
+ *    of a stream are joined, so fragmentation does not matter
+ *  - header fields keep only their name and value, since the compressor
+ *    picks the representation from its tables
+ *
+ * The HPACK dynamic tables of both ends must match afterwards as well.
+ * Returns true if everything matches; otherwise report, if given, says what
+ * did not.
+ */
+bool CheckRoundTrip(const h2proto::Sequence& seq, std::string *report = nullptr);
+
+/* Same for the request side of a whole connection */
+bool CheckRoundTrip(const h2proto::Conversation& conversation,
+        std::string *report = nullptr);
+
+/* Canonical form used by CheckRoundTrip */
+h2proto::Sequence CanonicalSequence(const h2proto::Sequence& seq);
@@ -0,0 +1,213 @@
+#include <algorithm>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "sequence_repair.h"
+#include "protobuf_encoders.h"
+
+uint32_t StreamRenumbering::open(uint32_t id)
+{
+    if (id) {
+        auto it = ids.find(id);
+        if (it != ids.end())
+            return latest = it->second;
+    }
+
+    latest = next;
+    if (next + 2 <= MAX_INT_31)
+        next += 2;
+    if (id)
+        ids[id] = latest;
+    return latest;
+}
+
+uint32_t StreamRenumbering::join(uint32_t id)
+{
+    if (id) {
+        auto it = ids.find(id);
+        if (it != ids.end())
+            return it->second;
+    }
+
+    // Nothing to join yet: the frame gets a stream of its own
+    return latest ? latest : open(id);
+}
+
+/* Dependencies may name idle streams, so only known ones are renumbered */
+static uint32_t repair_dependency(uint32_t dependency, uint32_t stream_id,
+        const StreamRenumbering& streams)
+{
+    auto it = streams.ids.find(dependency);
+    if (dependency && it != streams.ids.end())
+        dependency = it->second;
+
+    // A stream cannot depend on itself (RFC 7540 5.3.1)
+    return dependency == stream_id ? 0 : dependency;
+}
+
+void RepairStreamIds(h2proto::Sequence *seq, StreamRenumbering& streams)
+{
+    for (h2proto::Frame& frame : *seq->mutable_frames()) {
+        switch (frame.frame_oneof_case()) {
+        case h2proto::Frame::kDataFrame: {
+            auto *data = frame.mutable_data_frame();
+            data->set_stream_id(streams.join(data->stream_id()));
+            break;
+        }
+        case h2proto::Frame::kHeadersFrame: {
+            auto *headers = frame.mutable_headers_frame();
+            headers->set_stream_id(streams.open(headers->stream_id()));
+            headers->set_stream_dependency(repair_dependency(
+                    headers->stream_dependency(), headers->stream_id(), streams));
+            break;
+        }
+        case h2proto::Frame::kPriorityFrame: {
+            auto *priority = frame.mutable_priority_frame();
+            priority->set_stream_id(streams.join(priority->stream_id()));
+            priority->set_stream_dependency(repair_dependency(
+                    priority->stream_dependency(), priority->stream_id(), streams));
+            break;
+        }
+        case h2proto::Frame::kRstStreamFrame: {
+            auto *rst = frame.mutable_rst_stream_frame();
+            rst->set_stream_id(streams.join(rst->stream_id()));
+            break;
+        }
+        case h2proto::Frame::kPushPromiseFrame: {
+            auto *promise = frame.mutable_push_promise_frame();
+            promise->set_stream_id(streams.join(promise->stream_id()));
+            break;
+        }
+        case h2proto::Frame::kContinuationFrame: {
+            auto *continuation = frame.mutable_continuation_frame();
+            continuation->set_stream_id(streams.join(continuation->stream_id()));
+            break;
+        }
+        default:
+            // SETTINGS, PING, GOAWAY and WINDOW_UPDATE carry no stream here
+            break;
+        }
+    }
+}
+
+/* END_HEADERS and stream of a frame that can be part of a header block */
+static bool block_frame(const h2proto::Frame& frame, bool *end_headers,
+        uint32_t *stream_id)
+{
+    switch (frame.frame_oneof_case()) {
+    case h2proto::Frame::kHeadersFrame:
+        *end_headers = frame.headers_frame().end_headers();
+        *stream_id = frame.headers_frame().stream_id();
+        return true;
+    case h2proto::Frame::kPushPromiseFrame:
+        *end_headers = frame.push_promise_frame().end_headers();
+        *stream_id = frame.push_promise_frame().stream_id();
+        return true;
+    case h2proto::Frame::kContinuationFrame:
+        *end_headers = frame.continuation_frame().end_headers();
+        *stream_id = frame.continuation_frame().stream_id();
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void end_block(h2proto::Frame *frame)
+{
+    if (frame->has_headers_frame())
+        frame->mutable_headers_frame()->set_end_headers(true);
+    else if (frame->has_push_promise_frame())
+        frame->mutable_push_promise_frame()->set_end_headers(true);
+    else if (frame->has_continuation_frame())
+        frame->mutable_continuation_frame()->set_end_headers(true);
+}
+
+/* A CONTINUATION with no block to continue starts one of its own */
+static void continuation_to_headers(h2proto::Frame *frame)
+{
+    h2proto::ContinuationFrame *continuation = frame->mutable_continuation_frame();
+    h2proto::HeadersFrame headers;
+
+    headers.set_exclusive(false);
+    headers.set_stream_dependency(0);
+    headers.set_weight(0);
+    headers.mutable_header_list()->Swap(continuation->mutable_header_list());
+    headers.set_end_stream(false);
+    headers.set_end_headers(continuation->end_headers());
+    headers.set_priority(false);
+    headers.set_stream_id(continuation->stream_id());
+
+    frame->mutable_headers_frame()->Swap(&headers);
+}
+
+void RepairContinuations(h2proto::Sequence *seq)
+{
+    h2proto::Frame *open_block = nullptr;
+    uint32_t block_stream = 0;
+
+    for (h2proto::Frame& frame : *seq->mutable_frames()) {
+        if (frame.has_continuation_frame()) {
+            if (open_block)
+                frame.mutable_continuation_frame()->set_stream_id(block_stream);
+            else
+                continuation_to_headers(&frame);
+        }
+        else if (open_block) {
+            end_block(open_block);
+            open_block = nullptr;
+        }
+
+        bool end_headers;
+        uint32_t stream_id;
+        if (!block_frame(frame, &end_headers, &stream_id))
+            continue;
+
+        open_block = end_headers ? nullptr : &frame;
+        block_stream = stream_id;
+    }
+
+    if (open_block)
+        end_block(open_block);
+}
+
+void RepairPseudoHeaderOrder(
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> *fields)
+{
+    // Moves pointers only, the fields themselves stay where they are
+    std::stable_partition(fields->pointer_begin(), fields->pointer_end(),
+            [](const h2proto::HeaderField *field) {
+                return field->name().data().starts_with(':');
+            });
+}
+
+static void repair_frames(h2proto::Sequence *seq, StreamRenumbering& streams)
+{
+    RepairStreamIds(seq, streams);
+    RepairContinuations(seq);
+
+    for (h2proto::Frame& frame : *seq->mutable_frames()) {
+        if (frame.has_headers_frame())
+            RepairPseudoHeaderOrder(frame.mutable_headers_frame()->mutable_header_list());
+        else if (frame.has_push_promise_frame())
+            RepairPseudoHeaderOrder(frame.mutable_push_promise_frame()->mutable_header_list());
+    }
+}
+
+void RepairSequence(h2proto::Sequence *seq)
+{
+    StreamRenumbering streams;
+    repair_frames(seq, streams);
+}
+
+void RepairConversation(h2proto::Conversation *conversation)
+{
+    StreamRenumbering streams;
+
+    // Responses only get the new IDs: ResponseMatcher expects the frames
+    // on the streams of the repaired requests, with types left alone
+    for (h2proto::Exchange& exchange : *conversation->mutable_exchanges()) {
+        repair_frames(exchange.mutable_request_sequence(), streams);
+        RepairStreamIds(exchange.mutable_response_sequence(), streams);
+    }
+}
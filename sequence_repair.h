@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+/* Repairs for mutated inputs, so that a share of executions get past the
+ * connection-level checks every server does first. They only touch frame
+ * placement and stream IDs; payloads are left to the mutator.
+ */
+
+/* Client stream IDs in order of first use. A HEADERS frame on a stream not
+ * seen before opens the next odd ID; other frames on unknown streams (or
+ * stream 0, where a stream is required) join the latest open stream.
+ */
+struct StreamRenumbering {
+    std::unordered_map<uint32_t, uint32_t> ids;
+    uint32_t next = 1;
+    uint32_t latest = 0;
+
+    uint32_t open(uint32_t id);
+    uint32_t join(uint32_t id);
+};
+
+/* Renumber stream IDs to be odd and monotonic, and fix dependencies on
+ * the stream itself.
+ */
+void RepairStreamIds(h2proto::Sequence *seq, StreamRenumbering& streams);
+
+/* Make CONTINUATION chains valid: a stray CONTINUATION becomes a HEADERS
+ * frame, CONTINUATIONs follow the stream of their block, and a block that
+ * is interrupted or never finished gets END_HEADERS on its last frame.
+ */
+void RepairContinuations(h2proto::Sequence *seq);
+
+/* Move pseudo-header fields (":method", ...) ahead of regular ones */
+void RepairPseudoHeaderOrder(
+        google::protobuf::RepeatedPtrField<h2proto::HeaderField> *fields);
+
+/* All of the above on one sequence, or on every exchange of a connection
+ * with stream IDs shared between them. Response sequences of a
+ * conversation are renumbered along with the requests, nothing else.
+ */
+void RepairSequence(h2proto::Sequence *seq);
+void RepairConversation(h2proto::Conversation *conversation);
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <string_view>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "server_stub.h"
+#include "protobuf_encoders.h"
+#include "stage_timers.h"
+
+/* GOAWAY error code (RFC 7540 7) for each DecodeError; 0 is not fatal */
+static constexpr uint32_t goaway_error_codes[] = {
+    [DecodeError::TRUNCATED]            = 0,
+    [DecodeError::FRAME_SIZE_ERROR]     = 0x6,
+    [DecodeError::PROTOCOL_ERROR]       = 0x1,
+    [DecodeError::COMPRESSION_ERROR]    = 0x9,
+    [DecodeError::UNKNOWN_FRAME_TYPE]   = 0
+};
+
+static void add_header(h2proto::HeadersFrame& frame, const char *name,
+        const char *value)
+{
+    h2proto::HeaderField *field = frame.add_header_list();
+    field->mutable_name()->set_data(name);
+    field->mutable_name()->set_force_literal(false);
+    field->mutable_name()->set_huffman(false);
+    field->mutable_value()->set_data(value);
+    field->mutable_value()->set_force_literal(false);
+    field->mutable_value()->set_huffman(true);
+    field->set_indexing(h2proto::HeaderField_Indexing_INCREMENTAL);
+}
+
+ServerStub::ServerStub(std::pmr::memory_resource *memory)
+    : decoder(memory), encoder(memory)
+{
+}
+
+void ServerStub::receive(MemoryPipe& from_client, MemoryPipe& to_client)
+{
+    EncodeBuffer out(encoder.memory);
+
+    // Server preface: a SETTINGS frame, here with nothing in it
+    if (!settings_sent) {
+        h2proto::SettingsFrame settings;
+        settings.set_ack(false);
+        EncodeTo(settings, out, encoder);
+        settings_sent = true;
+    }
+
+    if (closed) {
+        from_client.consume(from_client.readable().size());
+        to_client.write(out);
+        return;
+    }
+
+    size_t first_error = decoder.errors.size();
+    from_client.consume(decoder.decode(from_client.readable(), &received));
+
+    for (; processed < received.frames_size() && !closed; processed++) {
+        frames++;
+        reply(received.frames(processed), out);
+    }
+
+    for (size_t i = first_error; i < decoder.errors.size() && !closed; i++) {
+        uint32_t error_code = goaway_error_codes[decoder.errors[i].code];
+        if (!error_code)
+            continue;
+
+        h2proto::GoawayFrame goaway;
+        goaway.set_last_stream_id(last_stream_id);
+        goaway.set_error_code(error_code);
+        EncodeTo(goaway, out, encoder);
+        goaway_sent = closed = true;
+    }
+
+    // Frames of an unfinished header block are still referenced
+    if (!decoder.block_open) {
+        received.Clear();
+        processed = 0;
+    }
+
+    to_client.write(out);
+}
+
+void ServerStub::reply(const h2proto::Frame& frame, EncodeBuffer& out)
+{
+    if (frame.has_settings_frame() && !frame.settings_frame().ack()) {
+        h2proto::SettingsFrame ack;
+        ack.set_ack(true);
+        EncodeTo(ack, out, encoder);
+        encoder.apply_peer_settings(frame.settings_frame());
+    }
+    else if (frame.has_ping_frame() && !frame.ping_frame().ack()) {
+        h2proto::PingFrame ack = frame.ping_frame();
+        ack.set_ack(true);
+        EncodeTo(ack, out, encoder);
+    }
+    else if (frame.has_headers_frame()) {
+        const h2proto::HeadersFrame& headers = frame.headers_frame();
+        last_stream_id = std::max(last_stream_id, headers.stream_id());
+
+        if (headers.end_stream())
+            respond(headers.stream_id(), out);
+    }
+    else if (frame.has_data_frame() && frame.data_frame().end_stream()) {
+        respond(frame.data_frame().stream_id(), out);
+    }
+    else if (frame.has_goaway_frame()) {
+        peer_goaway = closed = true;
+    }
+}
+
+/* 200 with a short body, once per client stream */
+void ServerStub::respond(uint32_t stream_id, EncodeBuffer& out)
+{
+    if (!(stream_id & 1) || !answered.insert(stream_id).second)
+        return;
+
+    requests++;
+
+    if (!response_headers.header_list_size()) {
+        response_headers.set_exclusive(false);
+        response_headers.set_stream_dependency(0);
+        response_headers.set_weight(0);
+        response_headers.set_end_stream(false);
+        response_headers.set_end_headers(true);
+        response_headers.set_priority(false);
+        add_header(response_headers, ":status", "200");
+        add_header(response_headers, "content-type", "text/plain");
+
+        response_body.set_data("ok\n");
+        response_body.set_end_stream(true);
+    }
+
+    response_headers.set_stream_id(stream_id);
+    EncodeTo(response_headers, out, encoder);
+
+    response_body.set_stream_id(stream_id);
+    EncodeTo(response_body, out, encoder);
+}
+
+ServerStubRun RunAgainstServerStub(const h2proto::Conversation& conversation,
+        EncodingContext& ctx)
+{
+    ServerStub server(ctx.memory);
+    MemoryPipe to_server(ctx.memory);
+    MemoryPipe to_client(ctx.memory);
+    ServerStubRun run;
+
+    EncodeBuffer out(ctx.memory);
+    for (const auto& exchange : conversation.exchanges()) {
+        {
+            STAGE_TIMER(FUZZ_STAGE_ENCODE);
+            out.clear();
+            EncodeTo(exchange, out, ctx);
+        }
+        run.bytes_sent += out.size();
+
+        {
+            STAGE_TIMER(FUZZ_STAGE_DELIVERY);
+            to_server.write(out);
+        }
+        {
+            STAGE_TIMER(FUZZ_STAGE_TARGET);
+            server.receive(to_server, to_client);
+        }
+
+        // Everything the stub wrote is complete frames
+        STAGE_TIMER(FUZZ_STAGE_DELIVERY);
+        std::string_view replies = to_client.readable();
+        run.bytes_received += replies.size();
+
+        ResponseMatcher& matcher = ctx.pending_responses.back();
+        matcher.feed(replies);
+        run.exchanges_matched += matcher.done();
+        ctx.pending_responses.pop_back();
+        to_client.consume(replies.size());
+
+        if (server.closed) {
+            run.goaway = server.goaway_sent;
+            run.peer_goaway = server.peer_goaway;
+            break;
+        }
+    }
+
+    run.frames = server.frames;
+    run.requests = server.requests;
+    return run;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_set>
+#include <memory_resource>
+
+#include "encoding_context.h"
+#include "protobuf_decoders.h"
+
+/* One direction of an in-memory connection */
+struct MemoryPipe {
+    MemoryPipe(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : buf(memory) {}
+
+    void write(std::string_view bytes) { buf.append(bytes); }
+    std::string_view readable() const { return std::string_view(buf).substr(read); }
+
+    void consume(size_t n) {
+        read += n;
+        if (read == buf.size()) {
+            buf.clear();
+            read = 0;
+        }
+    }
+
+    EncodeBuffer buf;
+    size_t read = 0;
+};
+
+/* Minimal in-process HTTP/2 server stand-in.
+ * Reads client bytes with FrameDecoder (so HPACK state is tracked like a
+ * real peer's) and answers the way a server would: its own SETTINGS first,
+ * ACKs for SETTINGS and PING, and a 200 response (HEADERS + DATA) once a
+ * request stream is half-closed. Any frame or HPACK error gets a GOAWAY with
+ * the matching error code, after which input is ignored. Responses are
+ * encoded with the regular encoders on the stub's own context.
+ */
+struct ServerStub {
+    ServerStub(std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+
+    /* Consume all complete frames in from_client, writing replies to to_client */
+    void receive(MemoryPipe& from_client, MemoryPipe& to_client);
+
+    FrameDecoder decoder;
+    EncodingContext encoder;
+
+    h2proto::Sequence received;
+    int processed = 0;
+
+    std::unordered_set<uint32_t> answered;
+    uint32_t last_stream_id = 0;
+    bool settings_sent = false;
+
+    // Input is ignored once closed, after a GOAWAY from either side
+    bool closed = false;
+    bool goaway_sent = false;
+    bool peer_goaway = false;
+
+    uint64_t frames = 0;
+    uint64_t requests = 0;
+
+    private:
+    void reply(const h2proto::Frame& frame, EncodeBuffer& out);
+    void respond(uint32_t stream_id, EncodeBuffer& out);
+
+    h2proto::HeadersFrame response_headers;
+    h2proto::DataFrame response_body;
+};
+
+struct ServerStubRun {
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_received = 0;
+    uint64_t frames = 0;
+    uint64_t requests = 0;
+    uint64_t exchanges_matched = 0;
+
+    // The stub rejected the connection, or the client sent a GOAWAY itself
+    bool goaway = false;
+    bool peer_goaway = false;
+};
+
+/* Drive a whole conversation against a fresh stub over memory pipes. Each
+ * exchange is encoded, handed to the stub, and paced on the stub's replies
+ * with the exchange's ResponseMatcher.
+ */
+ServerStubRun RunAgainstServerStub(const h2proto::Conversation& conversation,
+        EncodingContext& ctx);
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "stage_timers.h"
+
+const char *const fuzz_stage_names[FUZZ_STAGES] = {
+    "mutation",
+    "crossover",
+    "post_process",
+    "input",
+    "encode",
+    "delivery",
+    "target",
+    "roundtrip_check"
+};
+
+static StageHistogram histograms[FUZZ_STAGES];
+
+/* Nesting of the running timers. Inner stages are summed in pending until
+ * the outermost timer stops.
+ */
+static struct {
+    int depth;
+    uint64_t nested;
+    uint64_t pending[FUZZ_STAGES];
+    bool pending_hit[FUZZ_STAGES];
+
+    uint64_t interval_start;
+    uint64_t next_report;
+} timers;
+
+static int bucket_index(uint64_t ns)
+{
+    if (ns < STAGE_SUB_BUCKETS)
+        return ns;
+
+    // ns >> shift is in [16, 32)
+    int shift = std::bit_width(ns) - 5;
+    return (shift + 1) * STAGE_SUB_BUCKETS + (ns >> shift) - STAGE_SUB_BUCKETS;
+}
+
+static uint64_t bucket_upper_bound(int index)
+{
+    if (index < STAGE_SUB_BUCKETS)
+        return index;
+
+    int shift = index / STAGE_SUB_BUCKETS - 1;
+    uint64_t sub = index % STAGE_SUB_BUCKETS + STAGE_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void StageHistogram::record(uint64_t ns)
+{
+    ns = std::min(ns, ((uint64_t)1 << 40) - 1);
+
+    buckets[bucket_index(ns)]++;
+    count++;
+    total_ns += ns;
+    max_ns = std::max(max_ns, ns);
+}
+
+uint64_t StageHistogram::quantile(double q) const
+{
+    uint64_t rank = std::max((uint64_t)(q * count + 0.5), (uint64_t)1);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < STAGE_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return std::min(bucket_upper_bound(i), max_ns);
+    }
+    return max_ns;
+}
+
+uint64_t stage_clock()
+{
+    return std::chrono::steady_clock::now().time_since_epoch() /
+            std::chrono::nanoseconds(1);
+}
+
+/* H2_STAGE_OUT, or nullptr when there is nothing to report to */
+static const char *report_path()
+{
+    static const char *path = getenv("H2_STAGE_OUT");
+    return path;
+}
+
+static void report(const char *path)
+{
+    bool to_stderr = !strcmp(path, "-");
+    FILE *out = to_stderr ? stderr : fopen(path, "a");
+    if (!out)
+        return;
+
+    stage_dump(out);
+    if (!to_stderr)
+        fclose(out);
+}
+
+static void maybe_report(uint64_t now)
+{
+    static const uint64_t interval = [] {
+        const char *env = getenv("H2_STAGE_INTERVAL");
+        double seconds = env ? atof(env) : 10;
+        return (uint64_t)(std::max(seconds, 0.1) * 1e9);
+    }();
+
+    const char *path = report_path();
+    if (!path)
+        return;
+
+    if (!timers.next_report) {
+        timers.next_report = now + interval;
+    } else if (now >= timers.next_report) {
+        report(path);
+        stage_reset();
+        timers.next_report = now + interval;
+    }
+}
+
+StageTimer::StageTimer(FuzzStage stage)
+    : stage(stage), outer_nested(timers.nested)
+{
+    timers.nested = 0;
+    timers.depth++;
+    start = stage_clock();
+}
+
+StageTimer::~StageTimer()
+{
+    uint64_t now = stage_clock();
+    uint64_t elapsed = now - start;
+    uint64_t self = elapsed - std::min(timers.nested, elapsed);
+
+    timers.nested = outer_nested + elapsed;
+
+    if (--timers.depth) {
+        timers.pending[stage] += self;
+        timers.pending_hit[stage] = true;
+        return;
+    }
+
+    if (!timers.interval_start)
+        timers.interval_start = start;
+
+    histograms[stage].record(self);
+    for (int i = 0; i < FUZZ_STAGES; i++) {
+        if (timers.pending_hit[i])
+            histograms[i].record(timers.pending[i]);
+
+        timers.pending[i] = 0;
+        timers.pending_hit[i] = false;
+    }
+
+    timers.nested = 0;
+    maybe_report(now);
+}
+
+const StageHistogram& stage_histogram(FuzzStage stage)
+{
+    return histograms[stage];
+}
+
+void stage_reset()
+{
+    memset(histograms, 0, sizeof(histograms));
+    timers.interval_start = 0;
+}
+
+void stage_dump(FILE *out)
+{
+    uint64_t now = stage_clock();
+    double interval = timers.interval_start ? (now - timers.interval_start) / 1e9 : 0;
+
+    fprintf(out, "{\"time\": %ld, \"interval_s\": %.3f, \"stages\": {",
+            (long)time(nullptr), interval);
+
+    for (int i = 0; i < FUZZ_STAGES; i++) {
+        const StageHistogram& h = histograms[i];
+
+        fprintf(out, "%s\"%s\": {\"count\": %lu, \"mean_ns\": %lu, "
+                "\"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, "
+                "\"p999_ns\": %lu, \"max_ns\": %lu, \"total_ns\": %lu}",
+                i ? ", " : "", fuzz_stage_names[i], (unsigned long)h.count,
+                (unsigned long)(h.count ? h.total_ns / h.count : 0),
+                (unsigned long)h.quantile(0.5), (unsigned long)h.quantile(0.9),
+                (unsigned long)h.quantile(0.99), (unsigned long)h.quantile(0.999),
+                (unsigned long)h.max_ns, (unsigned long)h.total_ns);
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+}
+
+#ifdef H2_STAGE_TIMERS
+static void stage_dump_at_exit()
+{
+    const char *path = report_path();
+    if (path && timers.interval_start)
+        report(path);
+}
+
+static int stage_atexit = atexit(stage_dump_at_exit);
+#endif
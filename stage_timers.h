@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+/* Per-stage latency histograms for the fuzz loop.
+ * Build with -DH2_STAGE_TIMERS to time each stage of every iteration;
+ * without it STAGE_TIMER() expands to nothing. A stage timed while another
+ * one runs (post-processing inside mutation, encoding inside the input)
+ * is summed over the outer stage, recorded once per iteration, and not
+ * counted in the outer stage's own time.
+ *
+ * With H2_STAGE_OUT naming a file ("-" for stderr), the histograms are
+ * appended to it as one JSON line every H2_STAGE_INTERVAL seconds (10 by
+ * default) and at exit, and reset after each line. Timers keep global
+ * state, so use them from one thread only, as the fuzz loop does.
+ *
+ * ServerStub runs time encoding, delivery and the stub as the target.
+ * CheckRoundTrip is timed as a stage of its own, so that H2_ROUNDTRIP_CHECK
+ * does not show up as encoding or target time.
+ */
+#ifdef H2_STAGE_TIMERS
+#define STAGE_TIMER_NAME(line) stage_timer_##line
+#define STAGE_TIMER_LINE(stage, line) StageTimer STAGE_TIMER_NAME(line)(stage)
+#define STAGE_TIMER(stage) STAGE_TIMER_LINE(stage, __LINE__)
+#else
+#define STAGE_TIMER(stage)
+#endif
+
+enum FuzzStage {
+    FUZZ_STAGE_MUTATION,        // LPM mutation, post-processing excluded
+    FUZZ_STAGE_CROSSOVER,
+    FUZZ_STAGE_POST_PROCESS,
+    FUZZ_STAGE_INPUT,           // parsing the input and the fuzzer's own checks
+    FUZZ_STAGE_ENCODE,
+    FUZZ_STAGE_DELIVERY,        // moving bytes to the target and back
+    FUZZ_STAGE_TARGET,          // the target processing them
+    FUZZ_STAGE_ROUNDTRIP_CHECK, // CheckRoundTrip, encoding and decoding
+    FUZZ_STAGES
+};
+
+extern const char *const fuzz_stage_names[FUZZ_STAGES];
+
+/* HDR-style log-linear buckets: 16 per power of two, so every latency is
+ * kept to within 1/16, up to 2^40 ns (18 minutes)
+ */
+#define STAGE_SUB_BUCKETS 16
+#define STAGE_BUCKETS (37 * STAGE_SUB_BUCKETS)
+
+struct StageHistogram {
+    uint64_t buckets[STAGE_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+
+    void record(uint64_t ns);
+
+    /* Upper bound of the bucket holding the q-th quantile */
+    uint64_t quantile(double q) const;
+};
+
+class StageTimer {
+    public:
+    explicit StageTimer(FuzzStage stage);
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    private:
+    FuzzStage stage;
+    uint64_t start;
+    uint64_t outer_nested;
+};
+
+uint64_t stage_clock();
+const StageHistogram& stage_histogram(FuzzStage stage);
+void stage_reset();
+void stage_dump(FILE *out);
@@ -0,0 +1,280 @@
+#include <algorithm>
+
+#include "h2_frame_grammar.pb.h"
+#include "h2_sequence.pb.h"
+
+#include "stream_states.h"
+#include "protobuf_encoders.h"
+#include "frame_dispatch.h"
+#include "encoder_features.h"
+
+/* RFC 7540 7 */
+static constexpr uint32_t H2_PROTOCOL_ERROR = 0x1;
+static constexpr uint32_t H2_STREAM_CLOSED = 0x5;
+static constexpr uint32_t H2_REFUSED_STREAM = 0x7;
+
+/* SETTINGS, PING, GOAWAY and WINDOW_UPDATE have no stream field here */
+static bool frame_stream_id(const h2proto::Frame& frame, uint32_t *stream_id)
+{
+    return VisitFrame(frame, [&](const auto& f) {
+        if constexpr (requires { f.stream_id(); }) {
+            *stream_id = f.stream_id();
+            return true;
+        } else {
+            return false;
+        }
+    });
+}
+
+static void set_frame_stream_id(h2proto::Frame *frame, uint32_t stream_id)
+{
+    VisitFrame(frame, [&](auto& f) {
+        if constexpr (requires { f.set_stream_id(stream_id); })
+            f.set_stream_id(stream_id);
+    });
+}
+
+StreamState StreamTracker::state(uint32_t stream_id) const
+{
+    auto it = states.find(stream_id);
+    if (it != states.end())
+        return it->second;
+
+    // Opening a stream closes every idle stream below it (5.1.1)
+    return stream_id <= highest_opened ? StreamState::CLOSED : StreamState::IDLE;
+}
+
+StreamCheck StreamTracker::check(const h2proto::Frame& frame) const
+{
+    auto which = frame.frame_oneof_case();
+    uint32_t id;
+
+    if (which == h2proto::Frame::kContinuationFrame) {
+        if (!block_open || frame.continuation_frame().stream_id() != block_stream)
+            return { H2_PROTOCOL_ERROR, true, "CONTINUATION without a header block" };
+        return {};
+    }
+
+    if (block_open)
+        return { H2_PROTOCOL_ERROR, true, "frame inside a header block" };
+
+    if (!frame_stream_id(frame, &id))
+        return {};
+
+    if (which == h2proto::Frame::kPushPromiseFrame)
+        return { H2_PROTOCOL_ERROR, true, "PUSH_PROMISE from a client" };
+
+    if (!id)
+        return { H2_PROTOCOL_ERROR, true, "stream frame on stream 0" };
+
+    StreamState s = state(id);
+
+    switch (which) {
+    case h2proto::Frame::kHeadersFrame:
+        if (s == StreamState::IDLE) {
+            if (!(id & 1))
+                return { H2_PROTOCOL_ERROR, true, "even stream opened by a client" };
+            if (open_streams >= peer_max_concurrent_streams)
+                return { H2_REFUSED_STREAM, false, "over SETTINGS_MAX_CONCURRENT_STREAMS" };
+            return {};
+        }
+        if (s == StreamState::OPEN) {
+            if (!frame.headers_frame().end_stream())
+                return { H2_PROTOCOL_ERROR, false, "trailers without END_STREAM" };
+            return {};
+        }
+        // A lower ID than one already opened was closed implicitly; new
+        // streams must use increasing IDs (5.1.1)
+        if (!states.count(id))
+            return { H2_PROTOCOL_ERROR, true, "HEADERS on a skipped stream ID" };
+        return { H2_STREAM_CLOSED, false, "HEADERS on a closed stream" };
+
+    case h2proto::Frame::kDataFrame:
+        if (s == StreamState::IDLE)
+            return { H2_PROTOCOL_ERROR, true, "DATA on an idle stream" };
+        if (s != StreamState::OPEN)
+            return { H2_STREAM_CLOSED, false, "DATA on a closed stream" };
+        return {};
+
+    case h2proto::Frame::kRstStreamFrame:
+        if (s == StreamState::IDLE)
+            return { H2_PROTOCOL_ERROR, true, "RST_STREAM on an idle stream" };
+        return {};
+
+    default:
+        // PRIORITY is allowed in every state
+        return {};
+    }
+}
+
+void StreamTracker::set_state(uint32_t stream_id, StreamState next)
+{
+    StreamState& s = states[stream_id];
+    FEATURE(feature_stream_transition((int)s, (int)next));
+
+    // Half-closed streams end when the peer says so, which we cannot see, so
+    // only open ones count against the peer's concurrency limit
+    open_streams += (next == StreamState::OPEN) - (s == StreamState::OPEN);
+    if (next == StreamState::OPEN)
+        latest_open = stream_id;
+
+    s = next;
+}
+
+void StreamTracker::update(const h2proto::Frame& frame)
+{
+    switch (frame.frame_oneof_case()) {
+    case h2proto::Frame::kHeadersFrame: {
+        const h2proto::HeadersFrame& headers = frame.headers_frame();
+        uint32_t id = headers.stream_id();
+        StreamState s = state(id);
+
+        block_open = !headers.end_headers();
+        block_stream = id;
+
+        if (!id || s == StreamState::CLOSED || s == StreamState::HALF_CLOSED_LOCAL)
+            break;
+
+        if (s == StreamState::IDLE && (id & 1))
+            highest_opened = std::max(highest_opened, id);
+
+        set_state(id, headers.end_stream() ?
+                StreamState::HALF_CLOSED_LOCAL : StreamState::OPEN);
+        break;
+    }
+    case h2proto::Frame::kPushPromiseFrame:
+        block_open = !frame.push_promise_frame().end_headers();
+        block_stream = frame.push_promise_frame().stream_id();
+        break;
+
+    case h2proto::Frame::kContinuationFrame:
+        if (frame.continuation_frame().end_headers())
+            block_open = false;
+        break;
+
+    case h2proto::Frame::kDataFrame: {
+        uint32_t id = frame.data_frame().stream_id();
+        if (frame.data_frame().end_stream() && state(id) == StreamState::OPEN)
+            set_state(id, StreamState::HALF_CLOSED_LOCAL);
+        break;
+    }
+    case h2proto::Frame::kRstStreamFrame: {
+        uint32_t id = frame.rst_stream_frame().stream_id();
+        if (id && state(id) != StreamState::IDLE)
+            set_state(id, StreamState::CLOSED);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/* First stream ID a new stream can use, 0 once they have run out */
+uint32_t StreamTracker::next_stream_id() const
+{
+    if (!highest_opened)
+        return 1;
+    return highest_opened < MAX_INT_31 - 1 ? highest_opened + 2 : 0;
+}
+
+/* A stream on which frame is legal, if changing the stream is enough */
+bool StreamTracker::repair_stream(const h2proto::Frame& frame,
+        uint32_t *stream_id) const
+{
+    uint32_t next_idle = next_stream_id();
+    uint32_t open = state(latest_open) == StreamState::OPEN ? latest_open : 0;
+
+    if (!open) {
+        for (const auto& [id, s] : states)
+            if (s == StreamState::OPEN)
+                open = id;
+    }
+
+    switch (frame.frame_oneof_case()) {
+    case h2proto::Frame::kContinuationFrame:
+        *stream_id = block_stream;
+        return block_open;
+
+    case h2proto::Frame::kHeadersFrame:
+        *stream_id = next_idle;
+        return !block_open && next_idle && open_streams < peer_max_concurrent_streams;
+
+    case h2proto::Frame::kDataFrame:
+        *stream_id = open;
+        return !block_open && open;
+
+    case h2proto::Frame::kRstStreamFrame:
+        *stream_id = open ? open : highest_opened;
+        return !block_open && *stream_id;
+
+    case h2proto::Frame::kPriorityFrame:
+        *stream_id = next_idle;
+        return !block_open && next_idle;
+
+    default:
+        return false;
+    }
+}
+
+/* A stream that turns a legal frame into an illegal one */
+bool StreamTracker::violating_stream(const h2proto::Frame& frame,
+        uint32_t *stream_id) const
+{
+    uint32_t next_idle = next_stream_id();
+    StreamState latest = state(highest_opened);
+
+    switch (frame.frame_oneof_case()) {
+    case h2proto::Frame::kHeadersFrame:
+        // A stream we already finished, or else the connection
+        *stream_id = highest_opened && latest != StreamState::OPEN ? highest_opened : 0;
+        return true;
+
+    case h2proto::Frame::kDataFrame:
+    case h2proto::Frame::kRstStreamFrame:
+        *stream_id = next_idle;
+        return true;
+
+    case h2proto::Frame::kPriorityFrame:
+        *stream_id = 0;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+const h2proto::Frame& StreamTracker::apply(const h2proto::Frame& frame)
+{
+    if (policy.mode == StreamPolicy::UNTRACKED)
+        return frame;
+
+    const h2proto::Frame *sent = &frame;
+    StreamCheck verdict = check(frame);
+    uint32_t id;
+
+    bool stream_frame = frame_stream_id(frame, &id) &&
+            !frame.has_continuation_frame();
+
+    if (policy.mode == StreamPolicy::VIOLATE_ONCE && !violations &&
+            stream_frame && !verdict.error && stream_frames >= policy.violate_at &&
+            violating_stream(frame, &id)) {
+        rewritten = frame;
+        set_frame_stream_id(&rewritten, id);
+        sent = &rewritten;
+        violations++;
+    }
+    else if (verdict.error) {
+        illegal++;
+
+        if (policy.mode >= StreamPolicy::REPAIR && repair_stream(frame, &id)) {
+            rewritten = frame;
+            set_frame_stream_id(&rewritten, id);
+            sent = &rewritten;
+            repaired++;
+        }
+    }
+
+    stream_frames += stream_frame;
+    update(*sent);
+    return *sent;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_map>
+
+/* RFC 7540 5.1 stream states, as seen by the client that sends the frames.
+ * Only what we send is known, so streams go idle -> open -> half-closed
+ * (local) -> closed; the peer's END_STREAM and RST_STREAM never show up.
+ */
+enum class StreamState : uint8_t {
+    IDLE,
+    OPEN,
+    HALF_CLOSED_LOCAL,
+    CLOSED
+};
+
+/* What the Frame encoder does with the tracker */
+struct StreamPolicy {
+    enum Mode {
+        UNTRACKED,      // encode frames as given and keep no state
+        OBSERVE,        // track states and count illegal frames
+        REPAIR,         // move illegal frames to a stream where they are legal
+        VIOLATE_ONCE    // repair, but make exactly one legal frame illegal
+    } mode = UNTRACKED;
+
+    // VIOLATE_ONCE picks the first legal stream frame from this one on
+    // (counted from 0 over the connection)
+    uint32_t violate_at = 0;
+};
+
+/* Verdict for one frame. error is the RFC 7540 7 code the peer should
+ * answer with (0 if the frame is legal), as a GOAWAY if connection_error and
+ * an RST_STREAM otherwise.
+ */
+struct StreamCheck {
+    uint32_t error = 0;
+    bool connection_error = false;
+    const char *reason = nullptr;
+};
+
+/* Incremental stream state model, one per connection (EncodingContext).
+ * Each frame costs a hash lookup or two; repairs and violations only
+ * rewrite the stream ID, on a copy of the frame.
+ */
+struct StreamTracker {
+    StreamTracker(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : states(memory) {}
+
+    StreamState state(uint32_t stream_id) const;
+    uint32_t next_stream_id() const;
+
+    /* Would sending frame now be legal? Does not change any state */
+    StreamCheck check(const h2proto::Frame& frame) const;
+
+    /* Move streams along for a frame that is sent */
+    void update(const h2proto::Frame& frame);
+
+    /* Apply the policy to a frame about to be encoded and update the model.
+     * Returns frame itself, or a copy on another stream.
+     */
+    const h2proto::Frame& apply(const h2proto::Frame& frame);
+
+    StreamPolicy policy;
+
+    std::pmr::unordered_map<uint32_t, StreamState> states;
+    uint32_t highest_opened = 0;
+    uint32_t latest_open = 0;
+    uint32_t open_streams = 0;
+    uint32_t peer_max_concurrent_streams = UINT32_MAX;
+
+    bool block_open = false;
+    uint32_t block_stream = 0;
+
+    uint64_t stream_frames = 0;
+    uint64_t illegal = 0;
+    uint64_t repaired = 0;
+    uint64_t violations = 0;
+
+    private:
+    bool repair_stream(const h2proto::Frame& frame, uint32_t *stream_id) const;
+    bool violating_stream(const h2proto::Frame& frame, uint32_t *stream_id) const;
+    void set_state(uint32_t stream_id, StreamState state);
+
+    h2proto::Frame rewritten;
+};
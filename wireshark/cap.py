@@ -1,6 +1,7 @@
 import json
 import pdb
 import struct
+import sys
 import time
 from pprint import pprint #devonly
 
@@ -243,6 +244,10 @@ encoders = {
 }
 
 if __name__ == '__main__':
+    # Seeds are serialized protos, like the default fuzzer build reads;
+    # --text writes text protos for fuzzers built with -DH2_BINARY_CORPUS=0
+    text_seeds = '--text' in sys.argv[1:]
+
     body = None
     with open('cap.json') as f:
         body = json.load(f, object_pairs_hook=array_on_duplicate_keys)
@@ -297,7 +302,12 @@ if __name__ == '__main__':
                         not exchange.response_sequence.frames):
                         conversation.exchanges.remove(exchange)
 
-                with open(f'seed_corpus/seed_{int(time.time())}_{i}.txt', 'w') as f:
-                    f.write(text_format.MessageToString(conversation))
+                name = f'seed_corpus/seed_{int(time.time())}_{i}'
+                if text_seeds:
+                    with open(f'{name}.txt', 'w') as f:
+                        f.write(text_format.MessageToString(conversation))
+                else:
+                    with open(f'{name}.bin', 'wb') as f:
+                        f.write(conversation.SerializeToString())
 
                 i += 1
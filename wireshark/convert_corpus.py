@@ -0,0 +1,96 @@
+'''Convert a seed corpus between text and binary protobuf format.
+
+Fuzzers load serialized protos unless built with -DH2_BINARY_CORPUS=0; they
+parse much faster than text protos and take a fraction of the space. Usage:
+
+    python3 convert_corpus.py [--to-text] [--type Sequence] SRC_DIR DST_DIR
+
+Every file in SRC_DIR is converted to a file of the same name in DST_DIR
+(with the extension changed to .bin or .txt). Files that do not parse are
+reported and skipped. SRC_DIR may also be a corpus pack (corpus_pack.h),
+whose records are already binary.
+'''
+import argparse
+import os
+import struct
+import sys
+
+from google.protobuf import text_format
+from google.protobuf.message import DecodeError
+from h2_sequence_pb2 import Conversation, Sequence
+
+types = {
+    'Conversation': Conversation,
+    'Sequence': Sequence
+}
+
+def read_pack(path):
+    '''Yield (name, record) for each record of a corpus pack'''
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, count, _, index_offset = struct.unpack_from('>8sIIQ', data)
+    if magic != b'H2LPMPK1':
+        raise ValueError(f'{path}: not a corpus pack')
+
+    for i in range(count):
+        offset, = struct.unpack_from('>Q', data, index_offset + 8 * i)
+        length, = struct.unpack_from('>I', data, offset)
+        yield f'seed_{i}', data[offset + 4:offset + 4 + length]
+
+def read_dir(path):
+    for name in sorted(os.listdir(path)):
+        file = os.path.join(path, name)
+        if os.path.isfile(file):
+            with open(file, 'rb') as f:
+                yield name, f.read()
+
+def convert(data, message_type, to_text):
+    message = message_type()
+    if to_text:
+        message.ParseFromString(data)
+        return text_format.MessageToString(message).encode()
+    else:
+        text_format.Parse(data.decode(), message)
+        return message.SerializeToString()
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Convert a seed corpus between text and binary protos')
+    parser.add_argument('src')
+    parser.add_argument('dst')
+    parser.add_argument('--to-text', action='store_true',
+                        help='binary to text (default: text to binary)')
+    parser.add_argument('--type', choices=types.keys(), default='Conversation',
+                        help='top-level message of the fuzzer')
+    args = parser.parse_args()
+
+    os.makedirs(args.dst, exist_ok=True)
+    extension = '.txt' if args.to_text else '.bin'
+    converted = failed = 0
+    size_in = size_out = 0
+
+    from_pack = os.path.isfile(args.src)
+    seeds = read_pack(args.src) if from_pack else read_dir(args.src)
+
+    for name, data in seeds:
+        try:
+            if from_pack and not args.to_text:
+                out = data
+            else:
+                out = convert(data, types[args.type], args.to_text)
+        except (text_format.ParseError, DecodeError, UnicodeDecodeError) as e:
+            print(f'{name}: {e}', file=sys.stderr)
+            failed += 1
+            continue
+
+        out_name = os.path.splitext(name)[0] + extension
+        with open(os.path.join(args.dst, out_name), 'wb') as f:
+            f.write(out)
+
+        converted += 1
+        size_in += len(data)
+        size_out += len(out)
+
+    print(f'{converted} converted, {failed} failed, '
+          f'{size_in} -> {size_out} bytes')